@@ -9,25 +9,242 @@
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <limits.h>
+#include <string.h>
+#include <float.h>
 #include <math.h>
 
-#include "timer.h"
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+
 #include "m3d.h"
 #include "m4d.h"
+#include "ort.h"
 #include "eng.h"
+#include "conf.h"
 #include "ai.h"
 
+/*------------------------------------------------------------------------------
+   MACROS
+------------------------------------------------------------------------------*/
+
+/** Number of quarter turns tried in a plane */
+#define AITURNSTEPS 4
+
+/** Number of the turn combinations: AITURNSTEPS ^ AITURNS */
+#define AICOMBOS (1 << (2 * AITURNS))
+
+/** Maximal number of the threads of the search */
+#define AIMAXTHREADS 64
+
+/** Least number of the situations searched by a thread */
+#define AIMINPART 512
+
+/** Maximal width of the beam of the lookahead */
+#define AIMAXWIDTH 32
+
+/** Least number of the situations searched between the checks of the
+    time of planning */
+#define AIMINCHUNK 16
+
+/** Time of planning between the checks of the requests [nsec] */
+#define AISLICE 2000000
+
+/** Number of the buffers of a slot */
+#define AISLOTS 3
+
+/** Flag of a slot buffer published and not taken yet */
+#define AISLOTNEW 4
+
+/*------------------------------------------------------------------------------
+   TYPES
+------------------------------------------------------------------------------*/
+
+/** Features of the space evaluated */
+typedef enum
+{
+    eAiFeatCoG = 0,     /**< height of the center of gravity */
+    eAiFeatHeight,      /**< mean height of the columns */
+    eAiFeatHoles,       /**< empty cells under the tops of the columns,
+                             per column */
+    eAiFeatCleared,     /**< levels cleared by the solid */
+    eAiFeatVariance,    /**< variance of the fill of the levels used */
+    eAiFeatRoughness,   /**< height steps between the neighbouring columns,
+                             per column */
+    eAiFeatMaxHeight,   /**< height of the highest column */
+    eAiFeatNum
+} tAiFeature;
+
+/** Turn combinations tried: the numbers of quarter turns in the planes
+    as the digits of base AITURNSTEPS, the first plane the most
+    significant one. The combinations are listed in the order of the
+    search, the ones turning the solid to the same cells are left out. */
+typedef struct
+{
+    int                   num;      /**< number of the combinations */
+    const unsigned short *combo;    /**< the combinations */
+} tAiOrients;
+
+/** A thread of the search and its scratch state */
+typedef struct
+{
+    pthread_t  thread;      /**< the thread */
+    tEngSpace  space;       /**< copy of the space searched */
+    unsigned   job;         /**< number of the last job taken */
+    int        first;       /**< first situation of the part searched */
+    int        last;        /**< situation after the part searched */
+    int        bestSitu;    /**< best situation of the part, -1 if none */
+    double     bestScore;   /**< score of the best situation */
+} tAiWorker;
+
+/** A plan of the lookahead: the situation of the actual solid it starts
+    with, and the space after the placements of the solids planned */
+typedef struct
+{
+    int       root;     /**< situation of the actual solid */
+    tEngSpace space;    /**< space after the placements */
+} tAiPlan;
+
+/** A situation of a solid on the space of a plan, kept for the next
+    depth of the lookahead */
+typedef struct
+{
+    int               parent;   /**< index of the plan */
+    int               situ;     /**< situation of the solid */
+    const tAiOrients *pOrients; /**< turn combinations of the solid */
+    double            score;    /**< score of the situation */
+} tAiChild;
+
+/** State of planning the placement of a solid, resumed until done */
+typedef struct
+{
+    tEngObject        object;       /**< the solid planned for */
+    tEngSpace         space;        /**< the space it is placed in */
+    tEngObject        preview[ENGPREVIEW]; /**< the solids coming */
+    int               previewNum;   /**< number of the solids coming */
+    const tAiOrients *pRootOrients; /**< turn combinations of the solid */
+    tAiPlan           plans[2][AIMAXWIDTH]; /**< plans of two depths */
+    tAiPlan          *pPlans;       /**< plans of the depth */
+    tAiPlan          *pNext;        /**< plans of the next depth */
+    int               planNum;      /**< number of the plans of the depth */
+    int               depth;        /**< depth: solids placed before */
+    int               plan;         /**< plan expanded */
+    const tAiOrients *pOrients;     /**< turn combinations on the plan */
+    int               situ;         /**< next situation of the plan */
+    int               situNum;      /**< number of the situations of the
+                                         plan, -1 if not started */
+    tAiChild          best[AIMAXWIDTH]; /**< best situations of the depth */
+    int               bestNum;      /**< number of the best situations */
+    int               bestSitu;     /**< situation of the actual solid
+                                         starting the best plan so far */
+    int               nodes;        /**< number of the situations tried */
+    int               budget;       /**< flag of the budget reached */
+    int               done;         /**< flag of the plan done */
+    double           *pScores;      /**< scores of the situations */
+    int               scoresSize;   /**< size of pScores */
+    uint64_t          situTime;     /**< time of searching a situation
+                                         lately [nsec], 0 if unknown */
+} tAiPlanner;
+
+/** Steps to the situation planned for a solid, handed to the game */
+typedef struct
+{
+    int      solidnum;              /**< number of the solid */
+    uint64_t basis;                 /**< hash of the solid and the space
+                                         planned for */
+    int      done;                  /**< flag of the plan done, else the
+                                         best one so far */
+    int      turns[AITURNS];        /**< turns needed by axises */
+    int      moves[ENGLEVELDIM];    /**< moves needed by axises */
+} tAiSteps;
+
+/** Situation of the game to be planned for, handed to the planner */
+typedef struct
+{
+    int        solidnum;            /**< number of the solid */
+    tEngObject object;              /**< the solid */
+    tEngObject preview[ENGPREVIEW]; /**< the solids coming */
+    tEngSpace  space;               /**< the space */
+} tAiRequest;
+
+/** Autoplayer of a game. The game thread and the planner thread hand
+    the requests and the plans to each other through slots of three
+    buffers: the writer fills its back buffer and swaps it with the
+    middle one, the reader swaps its front buffer with the middle one if
+    that is new. Neither of them waits for the other, the newest one
+    replacing the buffer not taken yet. The plans of the actual solid
+    and of the next one are in two slots, by the parity of their
+    numbers, so the next one does not replace the actual one; the
+    planner goes no further ahead. */
+struct sAiGamer
+{
+    int        timeLeft;    /**< time left until the next step [msec] */
+    int        solidnum;    /**< number of the actual solid, -1 if none */
+    uint64_t   basis;       /**< hash of the actual solid and space */
+    int        startW;      /**< height of the solid at its start */
+    int        requested;   /**< flag of the solid requested to plan */
+    int        planned;     /**< flag of steps planned for the solid */
+    int        fixed;       /**< flag of the steps fixed */
+    tAiSteps   steps;       /**< the steps still to be made */
+    tAiSteps   latest[2];   /**< the newest plans taken, by parity */
+    atomic_int gameSolid;   /**< number of the actual solid, for the
+                                 planner */
+
+    struct
+    {
+        tAiRequest buf[AISLOTS];    /**< buffers */
+        atomic_int middle;          /**< middle buffer | AISLOTNEW */
+        int        back;            /**< buffer of the game thread */
+        int        front;           /**< buffer of the planner thread */
+    } requests;             /**< requests to plan, to the planner */
+
+    struct
+    {
+        tAiSteps   buf[AISLOTS];    /**< buffers */
+        atomic_int middle;          /**< middle buffer | AISLOTNEW */
+        int        back;            /**< buffer of the planner thread */
+        int        front;           /**< buffer of the game thread */
+    } plans[2];             /**< plans, to the game, by parity */
+
+    tAiPlanner      planner;    /**< planner, of the planner thread */
+    pthread_t       thread;     /**< the planner thread */
+    pthread_mutex_t lock;       /**< lock of waking the planner */
+    pthread_cond_t  wake;       /**< signal of a request, of a new solid
+                                     or of the stop */
+    atomic_int      stop;       /**< flag of stopping the planner */
+};
+
+typedef struct sAiGamer tAiGamer;
+
 /*------------------------------------------------------------------------------
    CONSTANTS
 ------------------------------------------------------------------------------*/
 
-/** Axices belongs to the turns around 1..4 axis */
-static const char aiTurnAxices[4][2] = {{0, 1},{1, 2},{2, 0},{0, 3}};
+/** Axices belongs to the turns around 1..AITURNS axis */
+static const char aiTurnAxices[AITURNS][2] =
+#if ENGDIM == 3
+    {{0, 1},{0, 2}};
+#elif ENGDIM == 4
+    {{0, 1},{1, 2},{2, 0},{0, 3}};
+#else
+    {{0, 1},{1, 2},{2, 3},{3, 0},{0, 4}};
+#endif
 
 /** Time step for AI turning object */
 static const int aiTimeStepTurn = 300;
 
+/** Names of the weights of the features in the configuration */
+static const char *aiFeatureNames[eAiFeatNum] =
+{
+    "ai_weight_cog",
+    "ai_weight_height",
+    "ai_weight_holes",
+    "ai_weight_cleared",
+    "ai_weight_variance",
+    "ai_weight_roughness",
+    "ai_weight_max_height"
+};
+
 /*------------------------------------------------------------------------------
    VARIABLES
 ------------------------------------------------------------------------------*/
@@ -35,19 +252,118 @@ static const int aiTimeStepTurn = 300;
 /** flag for auto gamer */
 static int aiAutoGamerON = 0;
 
+/** weights of the features of the space, the lower the weighted sum
+    the better the situation (by the order of tAiFeature) */
+static double aiWeights[eAiFeatNum] = {1.0, 0.0, 2.0, 0.0, 0.0, 0.5, 0.0};
+
+/** flag of weighting any of the features of the columns */
+static int aiColumnFeatures = 1;
+
+/** depth of the lookahead: number of the coming solids planned for,
+    0 for placing the actual one greedily */
+static int aiBeamDepth = 1;
+
+/** width of the beam: number of the best plans kept on each depth */
+static int aiBeamWidth = 4;
+
+/** budget of the lookahead: most situations tried for a solid */
+static int aiBeamNodes = 50000;
+
+/** distinct turn combinations by solid type and starting orientation,
+    built at their first search and published without a lock */
+static _Atomic(tAiOrients *) aiOrients[ENGOBJECTTYPES][ORTNUM];
+
+/** all of the turn combinations, built at the first search */
+static _Atomic(tAiOrients *) aiAllOrients;
+
+/** lock of the search pool, serving one search at a time, the
+    searches meanwhile are not split */
+static pthread_mutex_t aiSearchLock = PTHREAD_MUTEX_INITIALIZER;
+
+/** pool of the threads of the search, started by aiSetThreads() */
+static struct
+{
+    pthread_mutex_t lock;       /**< lock of the jobs */
+    pthread_cond_t  start;      /**< signal of a new job or of the stop */
+    pthread_cond_t  done;       /**< signal of the job done */
+    int             num;        /**< number of threads, the caller too */
+    unsigned        job;        /**< number of the actual job */
+    int             pending;    /**< number of workers busy with the job */
+    int             stop;       /**< flag of stopping the workers */
+    tEngObject      object;     /**< solid of the job */
+    const tAiOrients *pOrients; /**< turn combinations of the job */
+    double         *pScores;    /**< scores of the situations of the job,
+                                     NULL if not kept */
+    tAiWorker       workers[AIMAXTHREADS]; /**< the workers from 1 */
+} aiPool =
+{
+    .lock  = PTHREAD_MUTEX_INITIALIZER,
+    .start = PTHREAD_COND_INITIALIZER,
+    .done  = PTHREAD_COND_INITIALIZER,
+    .num   = 1
+};
+
 /*------------------------------------------------------------------------------
    PROTOTYPES
 ------------------------------------------------------------------------------*/
 
-static int aiFindBestSolution(int neededTurns[4],
-                              int neededMoves[4],
-                              tEngGame *pEngGame);
-static double aiProcessSitu(tEngGame *pEngGame);
-static int aiSearchBestSitu(double CoG[],
-                            int turns[],
-                            int situNum);
-static void aiDoStep(tEngGame *pEngGame);
-static int aiTimer(int interval, tEngGame *pEngGame);
+static void aiComboTurns(int combo, int turns[AITURNS]);
+static tAiOrients *aiNewOrients(const unsigned short *combos, int num);
+static tAiOrients *aiBuildOrients(const tEngObject *pObject,
+                                  const tEngSpace *pSpace);
+static tAiOrients *aiBuildAllOrients(void);
+static tAiOrients *aiPublishOrients(_Atomic(tAiOrients *) *pEntry,
+                                    tAiOrients *pOrients);
+static const tAiOrients *aiGetOrients(const tEngObject *pObject,
+                                      const tEngSpace *pSpace);
+static int aiSituNum(const tAiOrients *pOrients, const tEngSpace *pSpace);
+static void aiSituation(int situ,
+                        const tAiOrients *pOrients,
+                        int turns[AITURNS],
+                        int pos[ENGLEVELDIM],
+                        const tEngSpace *pSpace);
+static void aiPlaceObject(const int turns[AITURNS],
+                          const int pos[ENGLEVELDIM],
+                          tEngObject *pObject,
+                          const tEngSpace *pSpace);
+static void aiPlaceSitu(int situ,
+                        const tEngObject *pObject,
+                        const tAiOrients *pOrients,
+                        tEngPlacement *pPlacement,
+                        tEngSpace *pSpace);
+static double aiProcessSitu(int cleared, const tEngSpace *pSpace);
+static int aiSearchSitus(int first, int last,
+                         const tEngObject *pObject,
+                         const tAiOrients *pOrients,
+                         tEngSpace *pSpace,
+                         double *pScores,
+                         double *pBestScore);
+static void *aiWorkerThread(void *param);
+static int aiSearch(int first, int last,
+                    const tEngObject *pObject,
+                    const tAiOrients *pOrients,
+                    tEngSpace *pSpace,
+                    double *pScores,
+                    double *pBestScore);
+static void aiPlanInit(tAiPlanner *pPlanner);
+static void aiPlanFree(tAiPlanner *pPlanner);
+static void aiPlanStart(tAiPlanner *pPlanner,
+                        const tEngObject *pObject,
+                        const tEngSpace *pSpace,
+                        const tEngObject *pPreview,
+                        int previewNum);
+static void aiPlanNextDepth(tAiPlanner *pPlanner);
+static int aiPlanRun(tAiPlanner *pPlanner, uint64_t deadline);
+static void aiPlanSteps(const tAiPlanner *pPlanner,
+                        int neededTurns[AITURNS],
+                        int neededMoves[ENGLEVELDIM]);
+static tAiGamer *aiGetGamer(tEngGame *pEngGame);
+static int aiSlotPublish(atomic_int *pMiddle, int back);
+static int aiSlotTake(atomic_int *pMiddle, int *pFront);
+static void *aiGamerThread(void *param);
+static void aiGamerUpdate(tAiGamer *pGamer, tEngGame *pEngGame);
+static void aiDoStep(tAiGamer *pGamer, tEngGame *pEngGame);
+static void aiTimer(tAiGamer *pGamer, tEngGame *pEngGame);
 
 /*------------------------------------------------------------------------------
    FUNCTIONS
@@ -59,320 +375,1387 @@ int aiIsActive(void)
     return(aiAutoGamerON);
 }
 
+/** Set function for auto player enabled flag */
 void aiSetActive(int active, tEngGame *pEngGame)
 {
-    int timerMustStarted = (active && !aiAutoGamerON);
+    tAiGamer *pGamer = pEngGame->pAiGamer;
+
+    if (active && !aiAutoGamerON && (pGamer != NULL))
+    {
+        /*  first step at once, taking the plan of the solid again */
+        pGamer->timeLeft = 0;
+        pGamer->solidnum = -1;
+    }
 
     aiAutoGamerON = active;
+}
+
+/** Advances the autoplayer's clock by dt msec, making the steps due.
+ *  The autoplayer of the game is started at its first step, its plans
+ *  are taken as they come, never waiting for the search. */
+void aiStep(tEngGame *pEngGame, int dt)
+{
+    tAiGamer *pGamer;
 
-    if (timerMustStarted)
+    if (aiAutoGamerON)
     {
-        setTimerCallback(0, (tTimerCallback)aiTimer, pEngGame);
+        pGamer = aiGetGamer(pEngGame);
+
+        aiGamerUpdate(pGamer, pEngGame);
+
+        pGamer->timeLeft -= dt;
+
+        while (aiAutoGamerON && (pGamer->timeLeft <= 0))
+        {
+            aiTimer(pGamer, pEngGame);
+            pGamer->timeLeft += aiTimeStepTurn;
+        }
     }
 }
 
-/** Timer function for Autoplayer. */
-static int aiTimer(int interval, tEngGame *pEngGame)
+/** Places the actual solid to the best situation found and lands it
+ *  at once. Keeps no state between the calls, so games can be played
+ *  in parallel threads. */
+void aiPlaceSolid(tEngGame *pEngGame)
 {
-    interval = aiTimeStepTurn;
+    int i;
+    int neededTurns[AITURNS];
+    int neededMoves[ENGLEVELDIM];
 
-    if (aiAutoGamerON)
+    aiFindBestSolution(neededTurns, neededMoves, pEngGame);
+
+    for (i = 0; i < AITURNS; i++)
     {
-        if (pEngGame->gameOver == 0)
+        for (; neededTurns[i] > 0; neededTurns[i]--)
         {
-            aiDoStep(pEngGame);
-            return(interval);
+            engTurn(aiTurnAxices[i][0], aiTurnAxices[i][1], 1, 1, pEngGame);
         }
-        else
+    }
+
+    /*  move in one step as the search did */
+    for (i = 0; i < ENGLEVELDIM; i++)
+    {
+        if (neededMoves[i] != 0)
         {
-            aiAutoGamerON = 0;
-            return(0);
+            engMove(i, neededMoves[i], pEngGame);
         }
     }
-    else
+
+    engDropSolid(pEngGame);
+}
+
+/** Stops the autoplayer of a game and releases it, if started */
+void aiFreeGamer(tEngGame *pEngGame)
+{
+    tAiGamer *pGamer = pEngGame->pAiGamer;
+    int i;
+
+    if (pGamer == NULL)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&pGamer->lock);
+    atomic_store(&pGamer->stop, 1);
+    pthread_cond_signal(&pGamer->wake);
+    pthread_mutex_unlock(&pGamer->lock);
+
+    pthread_join(pGamer->thread, NULL);
+
+    for (i = 0; i < AISLOTS; i++)
+    {
+        engFreeSpace(&pGamer->requests.buf[i].space);
+    }
+    aiPlanFree(&pGamer->planner);
+    pthread_mutex_destroy(&pGamer->lock);
+    pthread_cond_destroy(&pGamer->wake);
+
+    free(pGamer);
+    pEngGame->pAiGamer = NULL;
+}
+
+/** The autoplayer of a game, started at the first call */
+static tAiGamer *aiGetGamer(tEngGame *pEngGame)
+{
+    tAiGamer *pGamer = pEngGame->pAiGamer;
+    int i;
+
+    if (pGamer != NULL)
+    {
+        return(pGamer);
+    }
+
+    pGamer = malloc(sizeof(tAiGamer));
+    if (pGamer == NULL)
+    {
+        fprintf(stderr, "Out of memory for the autoplayer\n");
+        exit(1);
+    }
+
+    pGamer->timeLeft  = 0;
+    pGamer->solidnum  = -1;
+    atomic_init(&pGamer->gameSolid, -1);
+
+    for (i = 0; i < AISLOTS; i++)
+    {
+        pGamer->requests.buf[i].space.arena     = NULL;
+        pGamer->requests.buf[i].space.arenaSize = 0;
+    }
+    pGamer->requests.back  = 0;
+    pGamer->requests.front = AISLOTS - 1;
+    atomic_init(&pGamer->requests.middle, 1);
+
+    for (i = 0; i < 2; i++)
+    {
+        pGamer->latest[i].solidnum = -1;
+        pGamer->plans[i].back      = 0;
+        pGamer->plans[i].front     = AISLOTS - 1;
+        atomic_init(&pGamer->plans[i].middle, 1);
+    }
+
+    aiPlanInit(&pGamer->planner);
+    atomic_init(&pGamer->stop, 0);
+    pthread_mutex_init(&pGamer->lock, NULL);
+    pthread_cond_init(&pGamer->wake, NULL);
+
+    if (pthread_create(&pGamer->thread, NULL, aiGamerThread, pGamer) != 0)
+    {
+        fprintf(stderr, "Could not start the autoplayer\n");
+        exit(1);
+    }
+
+    pEngGame->pAiGamer = pGamer;
+
+    return(pGamer);
+}
+
+/** Publishes the back buffer of a slot, the newest one replacing the
+ *  one not taken yet.
+ *  \return the new back buffer */
+static int aiSlotPublish(atomic_int *pMiddle, int back)
+{
+    return(atomic_exchange(pMiddle, back | AISLOTNEW) & ~AISLOTNEW);
+}
+
+/** Takes the newest buffer published to a slot, if any
+ *  \return 1 if taken to *pFront, 0 if nothing new */
+static int aiSlotTake(atomic_int *pMiddle, int *pFront)
+{
+    if ((atomic_load(pMiddle) & AISLOTNEW) == 0)
     {
         return(0);
     }
+
+    *pFront = atomic_exchange(pMiddle, *pFront) & ~AISLOTNEW;
+
+    return(1);
+}
+
+/** Thread function of the planner of an autoplayer. Plans the solid of
+ *  the newest request in slices, publishing the best plan after each.
+ *  When a plan is done, goes on with the next solid of the preview in
+ *  the space the plan leads to, once the solid planned is the actual
+ *  one. Sleeps while nothing is to be planned. */
+static void *aiGamerThread(void *param)
+{
+    tAiGamer *pGamer = param;
+    tAiPlanner *pPlanner = &pGamer->planner;
+    tAiRequest *pRequest;
+    tAiSteps *pSteps;
+    tEngPlacement placement;
+    tEngObject object;
+    int planning = 0;       /*  flag of a solid being planned */
+    int next = 0;           /*  flag of the next solid to be planned */
+    int solidnum = -1;      /*  number of the solid planned */
+    uint64_t basis = 0;     /*  hash of the situation planned for */
+    int slot;
+
+    for (;;)
+    {
+        /*  sleep until a request, or the solid planned is the actual
+            one if the next one is to be planned */
+        pthread_mutex_lock(&pGamer->lock);
+        while (   !planning
+               && !atomic_load(&pGamer->stop)
+               && !(atomic_load(&pGamer->requests.middle) & AISLOTNEW)
+               && !(next && (atomic_load(&pGamer->gameSolid) == solidnum)))
+        {
+            pthread_cond_wait(&pGamer->wake, &pGamer->lock);
+        }
+        pthread_mutex_unlock(&pGamer->lock);
+
+        if (atomic_load(&pGamer->stop))
+        {
+            break;
+        }
+
+        /*  the newest request replaces the plan in progress */
+        if (aiSlotTake(&pGamer->requests.middle, &pGamer->requests.front))
+        {
+            pRequest = &pGamer->requests.buf[pGamer->requests.front];
+
+            aiPlanStart(pPlanner, &pRequest->object, &pRequest->space,
+                        pRequest->preview, ENGPREVIEW);
+            solidnum = pRequest->solidnum;
+            basis    = engHashSpace(&pRequest->object, &pRequest->space);
+            planning = 1;
+            next     = 0;
+        }
+        else if (!planning)
+        {
+            /*  the next solid in the space planned, if it fits */
+            next = 0;
+
+            aiPlaceSitu(pPlanner->bestSitu, &pPlanner->object,
+                        pPlanner->pRootOrients, &placement,
+                        &pPlanner->space);
+
+            /*  a copy, the preview is shifted over its first solid */
+            object = pPlanner->preview[0];
+            if (engOverlapping(&object, &pPlanner->space))
+            {
+                continue;
+            }
+
+            aiPlanStart(pPlanner, &object, &pPlanner->space,
+                        &pPlanner->preview[1], pPlanner->previewNum - 1);
+            solidnum++;
+            basis    = engHashSpace(&pPlanner->object, &pPlanner->space);
+            planning = 1;
+        }
+
+        planning = !aiPlanRun(pPlanner, prfNow() + AISLICE);
+        next     = !planning && (pPlanner->previewNum > 0);
+
+        slot   = solidnum & 1;
+        pSteps = &pGamer->plans[slot].buf[pGamer->plans[slot].back];
+        pSteps->solidnum = solidnum;
+        pSteps->basis    = basis;
+        pSteps->done     = !planning;
+        aiPlanSteps(pPlanner, pSteps->turns, pSteps->moves);
+        pGamer->plans[slot].back = aiSlotPublish(&pGamer->plans[slot].middle,
+                                                 pGamer->plans[slot].back);
+    }
+
+    return(NULL);
+}
+
+/** Follows the game for the autoplayer: takes the newest plans, and asks
+ *  for one if none of them is for the actual solid in the actual space.
+ */
+static void aiGamerUpdate(tAiGamer *pGamer, tEngGame *pEngGame)
+{
+    tAiRequest *pRequest;
+    tAiSteps *pLatest;
+    int i;
+
+    if (pEngGame->gameOver)
+    {
+        return;
+    }
+
+    /*  a new solid, the planner may go on with the next one */
+    if (pGamer->solidnum != pEngGame->solidnum)
+    {
+        pGamer->solidnum  = pEngGame->solidnum;
+        pGamer->basis     = engHashSpace(&pEngGame->object,
+                                         &pEngGame->space);
+        pGamer->startW    = pEngGame->object.pos[ENGAXISW];
+        pGamer->planned   = 0;
+        pGamer->fixed     = 0;
+        pGamer->requested = 0;
+
+        atomic_store(&pGamer->gameSolid, pGamer->solidnum);
+
+        pthread_mutex_lock(&pGamer->lock);
+        pthread_cond_signal(&pGamer->wake);
+        pthread_mutex_unlock(&pGamer->lock);
+    }
+
+    for (i = 0; i < 2; i++)
+    {
+        if (aiSlotTake(&pGamer->plans[i].middle, &pGamer->plans[i].front))
+        {
+            pGamer->latest[i] = pGamer->plans[i].buf[pGamer->plans[i].front];
+        }
+    }
+
+    pLatest = &pGamer->latest[pGamer->solidnum & 1];
+
+    if (   (pLatest->solidnum == pGamer->solidnum)
+        && (pLatest->basis == pGamer->basis))
+    {
+        if (!pGamer->fixed)
+        {
+            pGamer->steps   = *pLatest;
+            pGamer->planned = 1;
+            pGamer->fixed   = pLatest->done;
+        }
+    }
+    else if (!pGamer->requested)
+    {
+        pRequest = &pGamer->requests.buf[pGamer->requests.back];
+
+        pRequest->solidnum = pEngGame->solidnum;
+        pRequest->object   = pEngGame->object;
+        for (i = 0; i < ENGPREVIEW; i++)
+        {
+            pRequest->preview[i] = *engPeekSolid(i, pEngGame);
+        }
+        engCopySpace(&pRequest->space, &pEngGame->space);
+
+        pGamer->requests.back = aiSlotPublish(&pGamer->requests.middle,
+                                              pGamer->requests.back);
+        pGamer->requested = 1;
+
+        pthread_mutex_lock(&pGamer->lock);
+        pthread_cond_signal(&pGamer->wake);
+        pthread_mutex_unlock(&pGamer->lock);
+    }
+}
+
+/** Timer function for Autoplayer. */
+static void aiTimer(tAiGamer *pGamer, tEngGame *pEngGame)
+{
+    if (pEngGame->gameOver == 0)
+    {
+        aiDoStep(pGamer, pEngGame);
+    }
+    else
+    {
+        aiAutoGamerON = 0;
+    }
 }
 
-/** Trigger the AI to make a turn. */
-static void aiDoStep(tEngGame *pEngGame)
+/** Trigger the AI to make a turn, by the plan of the actual solid. */
+static void aiDoStep(tAiGamer *pGamer, tEngGame *pEngGame)
 {
     /*  Local variables: */
     char stepMade = 0; /*  inditcator of turn already made; */
     int i;   /*  loop counters; */
-    /* Array of the number of turns by axises needed to the best situation. */
-    static int neededTurns[4];
-    static int neededMoves[4];
+    tAiSteps *pSteps = &pGamer->steps;
+
+    /*  If the plan of the solid is not done, */
+    if (!pGamer->fixed)
+    {
+        /*  wait for it until the solid is lowered, */
+        if (   !pGamer->planned
+            || (pEngGame->object.pos[ENGAXISW] == pGamer->startW))
+        {
+            return;
+        }
+
+        /*  then go with the best one so far. */
+        pGamer->fixed = 1;
+    }
+
+    /*  For each axis, */
+    for (i = 0; i < AITURNS; i++)
+    {
+        /*  if turn needed around and */
+        /*  not yet made any turn, then */
+        if (   (pSteps->turns[i] > 0)
+                && (!stepMade))
+        {
+            /*  turn around the axis, */
+            engTurn(aiTurnAxices[i][0],
+                    aiTurnAxices[i][1],
+                    1, 1, pEngGame);
+            /*  decrease the turns needed, and */
+            pSteps->turns[i]--;
+            /*  indicate it. */
+            stepMade = 1;
+        }
+    }
+    for (i = 0; i < ENGLEVELDIM; i++)
+    {
+        if (   (pSteps->moves[i] != 0)
+                && (!stepMade))
+        {
+            int direction = pSteps->moves[i] > 0 ? 1 : -1;
+            engMove(i, direction, pEngGame);
+            pSteps->moves[i] += -direction;
+            stepMade = 1;
+        }
+    }
+    /*  If no turn made, so no more turn needed, then */
+    if (!stepMade)
+    {
+        /*  drop the solid. */
+        engDropSolid(pEngGame);
+    }
+}
 
-    static int solidnum = -1;
+/** Decodes a turn combination to the numbers of turns in the planes */
+static void aiComboTurns(int combo, int turns[AITURNS])
+{
+    int i;
 
-    /*  If got a new solid, */
-    if (solidnum != pEngGame->solidnum)
+    for (i = AITURNS - 1; i >= 0; i--)
     {
-        /*  find the best situation (num of turns) to drop it. */
-        aiFindBestSolution(neededTurns, neededMoves, pEngGame);
+        turns[i] = combo % AITURNSTEPS;
+        combo /= AITURNSTEPS;
+    }
+}
 
-        solidnum = pEngGame->solidnum;
+/** Allocates a table of turn combinations
+ *  \return the new table */
+static tAiOrients *aiNewOrients(const unsigned short *combos, int num)
+{
+    tAiOrients *pOrients;
+
+    pOrients = malloc(sizeof(tAiOrients) + num * sizeof(unsigned short));
+    if (pOrients == NULL)
+    {
+        fprintf(stderr, "Out of memory for the turns of the search\n");
+        exit(1);
     }
-    else
+
+    pOrients->num   = num;
+    pOrients->combo = memcpy(pOrients + 1, combos,
+                             num * sizeof(unsigned short));
+
+    return(pOrients);
+}
+
+/** Builds the distinct turn combinations of a solid: of the ones turning
+ *  it to the same cells the first one is kept in the order of the search,
+ *  but with the turns of the cheapest one (fewest turns, the first of
+ *  the equal ones)
+ *  \return the new table */
+static tAiOrients *aiBuildOrients(const tEngObject *pObject,
+                                  const tEngSpace *pSpace)
+{
+    uint32_t masks[AICOMBOS];       /* cells of the distinct combinations */
+    unsigned short combos[AICOMBOS];
+    int costs[AICOMBOS];            /* number of turns of the combinations */
+    int turns[AITURNS];
+    int i, j, k, axis, bit, cost;
+    int num = 0;
+    uint32_t mask;
+    tEngObject object = *pObject;
+    tEngCells cells;
+
+    /*  cells around the position 1, the offsets of the blocks are 0 or -1 */
+    for (axis = 0; axis < ENGDIM; axis++)
+    {
+        object.pos[axis] = 1;
+    }
+
+    for (i = 0; i < AICOMBOS; i++)
     {
-        /*  else */
-        /*  For each axis, */
-        for (i = 0; i < 4; i++)
+        aiComboTurns(i, turns);
+
+        object.orient = pObject->orient;
+        cost = 0;
+
+        for (j = 0; j < AITURNS; j++)
         {
-            /*  if turn needed around and */
-            /*  not yet made any turn, then */
-            if (   (neededTurns[i] > 0)
-                    && (!stepMade)
-                    && (!pEngGame->lock))
+            for (k = 0; k < turns[j]; k++)
             {
-                /*  turn around the axis, */
-                engTurn(aiTurnAxices[i][0],
-                        aiTurnAxices[i][1],
-                        1, 1, pEngGame);
-                /*  decrease the turns needed, and */
-                neededTurns[i]--;
-                /*  indicate it. */
-                stepMade = 1;
+                object.orient = ortTurn(object.orient, aiTurnAxices[j][0],
+                                        aiTurnAxices[j][1], 1);
             }
+            cost += turns[j];
         }
-        for (i = 0; i < 3; i++)
+
+        engObject2Cells(&object, &cells, pSpace);
+
+        mask = 0;
+        for (k = 0; k < cells.num; k++)
         {
-            if (   (neededMoves[i] != 0)
-                    && (!stepMade)
-                    && (!pEngGame->lock))
+            bit = 0;
+            for (axis = 0; axis < ENGDIM; axis++)
             {
-                int direction = neededMoves[i] > 0 ? 1 : -1;
-                engMove(i, direction, pEngGame);
-                neededMoves[i] += -direction;
-                stepMade = 1;
+                bit |= cells.c[k][axis] << axis;
             }
+            mask |= (uint32_t)1 << bit;
+        }
+
+        for (k = 0; (k < num) && (masks[k] != mask); k++)
+        {
         }
-        /*  If no turn made, so no more turn needed, then */
-        if ((!stepMade) && (!pEngGame->lock))
+
+        if (k == num)
+        {
+            masks[num]  = mask;
+            combos[num] = i;
+            costs[num]  = cost;
+            num++;
+        }
+        else if (cost < costs[k])
         {
-            /*  drop the solid. */
-            engDropSolid(pEngGame);
+            combos[k] = i;
+            costs[k]  = cost;
         }
     }
+
+    return(aiNewOrients(combos, num));
+}
+
+/** Builds the table of all of the turn combinations
+ *  \return the new table */
+static tAiOrients *aiBuildAllOrients(void)
+{
+    unsigned short combos[AICOMBOS];
+    int i;
+
+    for (i = 0; i < AICOMBOS; i++)
+    {
+        combos[i] = i;
+    }
+
+    return(aiNewOrients(combos, AICOMBOS));
 }
 
-/** Finds the best situation from all turn variation
- *  (the most effective one with fewest turn).
- *  \return id of optimal turn variation */
-static int aiFindBestSolution(int neededTurns[4],
-                              int neededMoves[4],
-                              tEngGame *pEngGame)
+/** Publishes a table built to an empty entry. Of the tables built at
+ *  the same time by several threads the first one is kept, the others
+ *  are released.
+ *  \return the table of the entry */
+static tAiOrients *aiPublishOrients(_Atomic(tAiOrients *) *pEntry,
+                                    tAiOrients *pOrients)
 {
-    /*  Local variables: */
-    int i, j, n;             /*  loop counter; */
-    int x[7];                /*  loop counters; */
-    int bestSitu;            /*  number of the best situation */
-    tEngGame engGE;          /*  game engine copy; */
-    int index, pos;
-    /** Array contains the CenterOf Gravity of each situation. */
-    double CoG[(SPACESIZE-1) * (SPACESIZE-1) * (SPACESIZE-1) * 4 * 4 * 4 * 4];
-    /** Array contains the number of turns for each situation. */
-    int turns[(SPACESIZE-1) * (SPACESIZE-1) * (SPACESIZE-1) * 4 * 4 * 4 * 4];
+    tAiOrients *pExpected = NULL;
 
-    /*  For each turn number variation: */
-    for (x[6] = 0; x[6] < (pEngGame->size[0]-1); x[6]++)
-        for (x[5] = 0; x[5] < (pEngGame->size[1]-1); x[5]++)
-            for (x[4] = 0; x[4] < (pEngGame->size[2]-1); x[4]++)
-                for (x[3] = 0; x[3] < 4; x[3]++)
-                    for (x[1] = 0; x[1] < 4; x[1]++)
-                        for (x[2] = 0; x[2] < 4; x[2]++)
-                            for (x[0] = 0; x[0] < 4; x[0]++)
-                            {
-                                /*  Back up the actual situation. */
-                                engGE = *pEngGame;
-                                engGE.animation.enable = 0;
-                                engGE.lock = 0;
-
-                                for (j = 0; j < 4; j++)
-                                {
-                                    /*  Turn x[j] times around j.th axle. */
-                                    for (i = 0; i < x[j]; i++)
-                                    {
-                                        engTurn(aiTurnAxices[j][0],
-                                                aiTurnAxices[j][1],
-                                                1, 1, &engGE);
-                                    }
-                                }
-
-
-                                for (j = 0; j < 3; j++)
-                                {
-                                    pos = lround(engGE.object.pos.c[j] - 1);
-
-                                    engMove(j, x[6-j] - pos, &engGE);
-                                }
-
-                                while (engLowerSolid(&engGE)) {};
-
-                                /*  Number of the situation. */
-                                n =   x[6]*256*(pEngGame->size[2]-1)*(pEngGame->size[1]-1)
-                                      + x[5]*256*(pEngGame->size[1]-1)
-                                      + x[4]*256 +
-                                      + x[0]*64 + x[1]*16 + x[2]*4 + x[3];
-
-                                /*  Calculate Cog of the situation. */
-                                CoG[n] = aiProcessSitu(&engGE);
-
-                                /*  Calculate number of turns made. */
-                                /* \todo x4,x5,x6 wrong */
-                                turns[n] = x[0] + x[1] + x[2] + x[3] + x[4] + x[5] + x[6];
-                            }
-
-    /*  Return with the best of situations. */
-    bestSitu = aiSearchBestSitu(CoG, turns,
-                                (pEngGame->size[0]-1) *
-                                (pEngGame->size[1]-1) *
-                                (pEngGame->size[2]-1) *
-                                4 * 4 * 4 * 4);
-
-    /*  Fill the array of the required steps. */
-    engGE = *pEngGame;
-    neededTurns[3] = bestSitu % 4;
-    neededTurns[2] = bestSitu / 4 % 4;
-    neededTurns[1] = bestSitu / 16 % 4;
-    neededTurns[0] = bestSitu / 64 % 4;
-    index = bestSitu / 256 % (pEngGame->size[2]-1);
-    pos = lround(engGE.object.pos.c[2]) - 1;
-    neededMoves[2] = index - pos;
-    index = bestSitu / (256*(pEngGame->size[2]-1)) % (pEngGame->size[1]-1);
-    pos = lround(engGE.object.pos.c[1]) - 1;
-    neededMoves[1] = index - pos;
-    index = bestSitu / (256*(pEngGame->size[2]-1)*(pEngGame->size[1]-1)) % (pEngGame->size[0]-1);
-    pos = lround(engGE.object.pos.c[0]) - 1;
-    neededMoves[0] = index - pos;
-    return bestSitu;
+    if (!atomic_compare_exchange_strong(pEntry, &pExpected, pOrients))
+    {
+        free(pOrients);
+        pOrients = pExpected;
+    }
 
-}  /*  End of function */
+    return(pOrients);
+}
 
-/** Calculate Center of gravity of the game space with landed object.
- *  \return height (on 4th axis) of CoG */
-static double aiProcessSitu(tEngGame *pEngGame)
+/** Turn combinations to be tried with a solid. The distinct ones are
+ *  enough if no turn can be blocked: the cells of the solid stay in the
+ *  box of 2 cells on every axis below its position, so if the box is in
+ *  the space and empty. All of them otherwise.
+ *  \return the combinations */
+static const tAiOrients *aiGetOrients(const tEngObject *pObject,
+                                      const tEngSpace *pSpace)
 {
-    /*  Loop counters for axises. */
-    int x, y, z, l;
-    /*  Center of gravity on l axis, sum of full cells. */
-    int cog, sum;
+    int cell[ENGDIM];
+    int n, axis, limit;
+    int boxFree = 1;
+    _Atomic(tAiOrients *) *pEntry;
+    const tAiOrients *pOrients;
 
-    cog = 0;
-    sum = 0;
+    for (n = 0; (n < (1 << ENGDIM)) && boxFree; n++)
+    {
+        for (axis = 0; axis < ENGDIM; axis++)
+        {
+            limit = (axis == ENGAXISW) ? pSpace->length : pSpace->size[axis];
+            cell[axis] = pObject->pos[axis] - 1 + ((n >> axis) & 1);
+            boxFree &= (cell[axis] >= 0) && (cell[axis] < limit);
+        }
 
-    /*  For each cell of gamespace, */
-    for (l = 0; l < pEngGame->spaceLength; l++)
-        for (x = 0; x < pEngGame->size[0]; x++)
-            for (y = 0; y < pEngGame->size[1]; y++)
-                for (z = 0; z < pEngGame->size[2]; z++)
-                {
-                    /*  if the cell is full, */
-                    if (engGetSpaceCell(l,x,y,z, pEngGame))
-                    {
-                        /*  inrease sum and */
-                        sum += 1;
-                        /*  add the position to Cog. */
-                        cog += l;
-                    }
-                }
+        boxFree = boxFree && !engGetCell(cell, pSpace);
+    }
 
-    /*  'Normalise' CoG. */
-    return ( (sum == 0) ? 0.0 : (double)cog / sum);
-}  /*  End of function. */
+    pEntry   = boxFree ? &aiOrients[pObject->type][pObject->orient]
+                       : &aiAllOrients;
+    pOrients = atomic_load(pEntry);
 
-/** Search the best situation.
- *  \return ID of optimal situation */
-static int aiSearchBestSitu(double CoG[],
-                            int turns[],
-                            int situNum)
+    if (pOrients == NULL)
+    {
+        pOrients = aiPublishOrients(pEntry, boxFree
+                                            ? aiBuildOrients(pObject, pSpace)
+                                            : aiBuildAllOrients());
+    }
+
+    return(pOrients);
+}
+
+/** Number of situations tried: the turn combinations at all positions */
+static int aiSituNum(const tAiOrients *pOrients, const tEngSpace *pSpace)
 {
-    /*  Local variables: */
-    int i,       /*  loop counter; */
-        cntCog,  /*  counter for; */
-        cntTurn, /*  counter for turns; */
-        bestSitu;/*  selected best situation */
-    /*  best situation container array; */
-    int *bestSitusCog  = malloc(situNum * sizeof(int));
-    /*  best situation container array; */
-    int *bestSitusTurn = malloc(situNum * sizeof(int));
+    int i;
+    int num = pOrients->num;
+
+    for (i = 0; i < ENGLEVELDIM; i++)
+    {
+        num *= pSpace->size[i] - 1;
+    }
+
+    return(num);
+}
+
+/** Decodes the number of a situation to the turns around the axices and
+ *  the position on the level axices. The position on the first axis is
+ *  the most significant digit of the number, the turn combination is
+ *  the least significant one. */
+static void aiSituation(int situ,
+                        const tAiOrients *pOrients,
+                        int turns[AITURNS],
+                        int pos[ENGLEVELDIM],
+                        const tEngSpace *pSpace)
+{
+    int i;
+
+    aiComboTurns(pOrients->combo[situ % pOrients->num], turns);
+    situ /= pOrients->num;
+
+    for (i = ENGLEVELDIM - 1; i >= 0; i--)
+    {
+        pos[i] = 1 + situ % (pSpace->size[i] - 1);
+        situ /= pSpace->size[i] - 1;
+    }
+}
+
+/** Places the solid to a situation on a space and lands it at once,
+ *  the way the auto gamer would do. The placement is undone by
+ *  engUndoPlacement(). */
+static void aiPlaceSitu(int situ,
+                        const tEngObject *pObject,
+                        const tAiOrients *pOrients,
+                        tEngPlacement *pPlacement,
+                        tEngSpace *pSpace)
+{
+    int situTurns[AITURNS];  /*  turns of the situation; */
+    int situPos[ENGLEVELDIM];/*  position of the situation; */
+    tEngObject object;       /*  object placed; */
+    tEngCells cells;         /*  cells of the placed object; */
+
+    aiSituation(situ, pOrients, situTurns, situPos, pSpace);
+
+    /*  Start from the actual situation. */
+    object = *pObject;
+
+    aiPlaceObject(situTurns, situPos, &object, pSpace);
+
+    /*  Land the solid at once. */
+    object.pos[ENGAXISW] -= engDropDistance(&object, pSpace);
+    engObject2Cells(&object, &cells, pSpace);
+    engPlaceCells(&cells, pPlacement, pSpace);
+}
+
+/** Tries the situations first..last-1 of the solid on a space, placing
+ *  it and undoing the placement, restoring the space exactly. The score
+ *  of the situation n is stored to pScores[n] if pScores is not NULL.
+ *  \return the best of them: the one with the lowest score, the first of
+ *          the equal ones; -1 if none */
+static int aiSearchSitus(int first, int last,
+                         const tEngObject *pObject,
+                         const tAiOrients *pOrients,
+                         tEngSpace *pSpace,
+                         double *pScores,
+                         double *pBestScore)
+{
+    int n;                   /*  loop counter; */
+    int bestSitu = -1;       /*  number of the best situation */
+    double score;            /*  score of a situation */
+    tEngPlacement placement; /*  changes of the space to be undone; */
+
+    *pBestScore = DBL_MAX;
+
+    /*  For each turn number variation: */
+    for (n = first; n < last; n++)
+    {
+        aiPlaceSitu(n, pObject, pOrients, &placement, pSpace);
+
+        /*  Evaluate the situation. */
+        score = aiProcessSitu(placement.clearedNum, pSpace);
+
+        engUndoPlacement(&placement, pSpace);
+
+        if (pScores != NULL)
+        {
+            pScores[n] = score;
+        }
+
+        /*  keep the first of the lowest ones */
+        if (score < *pBestScore)
+        {
+            *pBestScore = score;
+            bestSitu    = n;
+        }
+    }
 
-    /*  lowest value of Cog; */
-    double lowerCog = INT_MAX;
-    /*  lowest value of turn numbers. */
-    double fewerTurn = situNum;
+    return(bestSitu);
+}
+
+/** Thread function of a worker of the search pool: searches its part
+ *  of the situations of each job on its copy of the space */
+static void *aiWorkerThread(void *param)
+{
+    tAiWorker *pWorker = param;
 
-    /*  Find the minimal CoG result. */
+    pthread_mutex_lock(&aiPool.lock);
 
-    /*  For each situation */
-    for (i = 0; i < situNum; i++)
+    for (;;)
     {
-        /*  If actual CoG lower then lowest, */
-        if (CoG[i] < lowerCog)
+        while (!aiPool.stop && (aiPool.job == pWorker->job))
+        {
+            pthread_cond_wait(&aiPool.start, &aiPool.lock);
+        }
+
+        if (aiPool.stop)
+        {
+            break;
+        }
+
+        pWorker->job = aiPool.job;
+        pthread_mutex_unlock(&aiPool.lock);
+
+        pWorker->bestSitu = aiSearchSitus(pWorker->first, pWorker->last,
+                                          &aiPool.object, aiPool.pOrients,
+                                          &pWorker->space, aiPool.pScores,
+                                          &pWorker->bestScore);
+
+        pthread_mutex_lock(&aiPool.lock);
+
+        if (--aiPool.pending == 0)
         {
-            /*  the actual is the lowest. */
-            lowerCog = CoG[i];
+            pthread_cond_signal(&aiPool.done);
         }
     }
 
-    /*  No best situation found. */
-    cntCog = 0;
+    pthread_mutex_unlock(&aiPool.lock);
+
+    return(NULL);
+}
+
+/** Get function for the number of threads of the search */
+int aiGetThreads(void)
+{
+    return(aiPool.num);
+}
+
+/** Set function for the number of threads of the search (the caller's
+ *  one included), 0 for the number of processors. Not to be called
+ *  while searching. */
+void aiSetThreads(int num)
+{
+    int i;
+
+    if (num <= 0)
+    {
+#ifdef _SC_NPROCESSORS_ONLN
+        num = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+        num = (num < 1) ? 1 : num;
+    }
+    num = (num > AIMAXTHREADS) ? AIMAXTHREADS : num;
+
+    pthread_mutex_lock(&aiSearchLock);
 
-    /*  For each situation */
-    for (i = 0; i < situNum; i++)
+    /*  stop the actual workers */
+    pthread_mutex_lock(&aiPool.lock);
+    aiPool.stop = 1;
+    pthread_cond_broadcast(&aiPool.start);
+    pthread_mutex_unlock(&aiPool.lock);
+
+    for (i = 1; i < aiPool.num; i++)
+    {
+        pthread_join(aiPool.workers[i].thread, NULL);
+        engFreeSpace(&aiPool.workers[i].space);
+    }
+
+    /*  start the new ones, the first one is the caller */
+    aiPool.stop = 0;
+    aiPool.num  = 1;
+
+    for (i = 1; i < num; i++)
     {
-        /*  If the situations cog is the best */
-        if (CoG[i] == lowerCog)
+        tAiWorker *pWorker = &aiPool.workers[i];
+
+        pWorker->space.arena     = NULL;
+        pWorker->space.arenaSize = 0;
+        pWorker->job             = aiPool.job;
+
+        if (pthread_create(&pWorker->thread, NULL,
+                           aiWorkerThread, pWorker) != 0)
         {
-            return i;
+            break;
+        }
 
-            /*  the situ. is one of the best situs. */
-            bestSitusCog[cntCog] = i;
-            /*  Increase counter. */
-            cntCog++;
+        aiPool.num++;
+    }
+
+    pthread_mutex_unlock(&aiSearchLock);
+}
+
+/** Loads the weights of the features of the evaluation and the limits
+ *  of the lookahead from the configuration, keeping the ones not set.
+ *  Not to be called while searching. */
+void aiLoadConf(void)
+{
+    int i, exists;
+    double weight, value;
+
+    for (i = 0; i < eAiFeatNum; i++)
+    {
+        weight = confGetVar((char *)aiFeatureNames[i], &exists);
+        if (exists)
+        {
+            aiWeights[i] = weight;
         }
     }
 
+    aiColumnFeatures =    (aiWeights[eAiFeatHeight] != 0.0)
+                       || (aiWeights[eAiFeatHoles] != 0.0)
+                       || (aiWeights[eAiFeatRoughness] != 0.0);
+
+    value = confGetVar("ai_beam_depth", &exists);
+    if (exists)
+    {
+        aiBeamDepth = (value < 0) ? 0 : (value > ENGPREVIEW) ? ENGPREVIEW
+                                                              : value;
+    }
+
+    value = confGetVar("ai_beam_width", &exists);
+    if (exists)
+    {
+        aiBeamWidth = (value < 1) ? 1 : (value > AIMAXWIDTH) ? AIMAXWIDTH
+                                                              : value;
+    }
+
+    value = confGetVar("ai_beam_nodes", &exists);
+    if (exists)
+    {
+        aiBeamNodes = (value < 0) ? 0 : value;
+    }
+}
+
+/** Searches the situations first..last-1 of a solid on a space. They
+ *  are split to equal parts searched by the threads of the pool, the
+ *  parts of the workers on copies of the space, the first one in the
+ *  space by the caller. The best of the parts are reduced in order, so
+ *  the result does not depend on the number of threads. While the pool
+ *  serves another caller, the search is done by the caller alone. The
+ *  scores of the situations are stored to pScores if it is not NULL.
+ *  \return the best situation, the first of the lowest scores */
+static int aiSearch(int first, int last,
+                    const tEngObject *pObject,
+                    const tAiOrients *pOrients,
+                    tEngSpace *pSpace,
+                    double *pScores,
+                    double *pBestScore)
+{
+    int i;                   /*  loop counter; */
+    int situNum;             /*  number of situations; */
+    int bestSitu;            /*  number of the best situation */
+    int num;                 /*  number of the parts searched */
+    tAiWorker *pWorker;
+
+    situNum = last - first;
 
-    /*  Find the one with minimal turning number */
-    /*  from best situations. */
+    num = situNum / AIMINPART;
 
-    /*  For each best situation */
-    for (i = 0; i < cntCog; i++)
+    /*  split by the pool if large enough and the pool not busy */
+    if ((num > 1) && (pthread_mutex_trylock(&aiSearchLock) == 0))
     {
-        /*  if actual situ. turns num. fewer then lowest, */
-        if (turns[bestSitusCog[i]] < fewerTurn)
+        num = (num > aiPool.num) ? aiPool.num : num;
+
+        if (num <= 1)
         {
-            /*  the actual situs's turn num is the fewest. */
-            fewerTurn = turns[bestSitusCog[i]];
+            pthread_mutex_unlock(&aiSearchLock);
         }
     }
+    else
+    {
+        num = 1;
+    }
 
-    /*  No best situation found regarding turn numbers. */
-    cntTurn = 0;
+    if (num <= 1)
+    {
+        /*  Placements are tried in the space and undone, restoring it
+            exactly. */
+        return(aiSearchSitus(first, last, pObject, pOrients, pSpace,
+                             pScores, pBestScore));
+    }
 
-    /*  For the best situations */
-    for (i = 0; i < cntCog; i++)
+    /*  the parts of the workers, the rest idle */
+    for (i = 1; i < aiPool.num; i++)
     {
-        /*  if the turn number match with the best, */
-        if (turns[bestSitusCog[i]] == fewerTurn)
+        pWorker = &aiPool.workers[i];
+
+        pWorker->first = (i < num) ? first + (long)situNum * i / num : 0;
+        pWorker->last  = (i < num) ? first + (long)situNum * (i + 1) / num
+                                   : 0;
+
+        if (i < num)
         {
-            return i;
-            /*  the situation is best. */
-            bestSitusTurn[cntTurn] = i;
-            /*  Increase counter. */
-            cntTurn++;
+            engCopySpace(&pWorker->space, pSpace);
         }
     }
 
-    bestSitu = bestSitusTurn[rand() % cntTurn];
+    pthread_mutex_lock(&aiPool.lock);
+    aiPool.object   = *pObject;
+    aiPool.pOrients = pOrients;
+    aiPool.pScores  = pScores;
+    aiPool.pending  = aiPool.num - 1;
+    aiPool.job++;
+    pthread_cond_broadcast(&aiPool.start);
+    pthread_mutex_unlock(&aiPool.lock);
+
+    /*  the first part by the caller */
+    bestSitu = aiSearchSitus(first, first + situNum / num, pObject,
+                             pOrients, pSpace, pScores, pBestScore);
+
+    pthread_mutex_lock(&aiPool.lock);
+    while (aiPool.pending > 0)
+    {
+        pthread_cond_wait(&aiPool.done, &aiPool.lock);
+    }
+    pthread_mutex_unlock(&aiPool.lock);
+
+    /*  the first of the lowest ones in the order of the parts */
+    for (i = 1; i < num; i++)
+    {
+        pWorker = &aiPool.workers[i];
+
+        if ((pWorker->bestSitu >= 0) && (pWorker->bestScore < *pBestScore))
+        {
+            *pBestScore = pWorker->bestScore;
+            bestSitu    = pWorker->bestSitu;
+        }
+    }
 
-    free(bestSitusCog);
-    free(bestSitusTurn);
+    pthread_mutex_unlock(&aiSearchLock);
 
-    /*  Select one from the best situations and return */
     return(bestSitu);
+}
+
+/** Initialises a planner with nothing planned */
+static void aiPlanInit(tAiPlanner *pPlanner)
+{
+    int i;
+
+    for (i = 0; i < AIMAXWIDTH; i++)
+    {
+        pPlanner->plans[0][i].space.arena     = NULL;
+        pPlanner->plans[0][i].space.arenaSize = 0;
+        pPlanner->plans[1][i].space.arena     = NULL;
+        pPlanner->plans[1][i].space.arenaSize = 0;
+    }
+
+    pPlanner->space.arena     = NULL;
+    pPlanner->space.arenaSize = 0;
+    pPlanner->pScores         = NULL;
+    pPlanner->scoresSize      = 0;
+    pPlanner->situTime        = 0;
+    pPlanner->done            = 1;
+    pPlanner->bestSitu        = -1;
+}
+
+/** Releases the memory of a planner */
+static void aiPlanFree(tAiPlanner *pPlanner)
+{
+    int i;
+
+    for (i = 0; i < AIMAXWIDTH; i++)
+    {
+        engFreeSpace(&pPlanner->plans[0][i].space);
+        engFreeSpace(&pPlanner->plans[1][i].space);
+    }
+
+    engFreeSpace(&pPlanner->space);
+    free(pPlanner->pScores);
+    aiPlanInit(pPlanner);
+}
+
+/** Starts planning the placement of a solid in a space, with the coming
+ *  solids known. The space and the solids are copied; the space may be
+ *  the one of the planner. */
+static void aiPlanStart(tAiPlanner *pPlanner,
+                        const tEngObject *pObject,
+                        const tEngSpace *pSpace,
+                        const tEngObject *pPreview,
+                        int previewNum)
+{
+    int i;
+
+    if (pSpace != &pPlanner->space)
+    {
+        engCopySpace(&pPlanner->space, pSpace);
+    }
+
+    /*  in order, the preview may be the one of the planner shifted */
+    for (i = 0; i < previewNum; i++)
+    {
+        pPlanner->preview[i] = pPreview[i];
+    }
+
+    pPlanner->object       = *pObject;
+    pPlanner->previewNum   = previewNum;
+    pPlanner->pRootOrients = aiGetOrients(pObject, &pPlanner->space);
+    pPlanner->pPlans       = pPlanner->plans[0];
+    pPlanner->pNext        = pPlanner->plans[1];
+    pPlanner->planNum      = 1;
+    pPlanner->depth        = 0;
+    pPlanner->plan         = 0;
+    pPlanner->situ         = 0;
+    pPlanner->situNum      = -1;
+    pPlanner->bestNum      = 0;
+    pPlanner->bestSitu     = -1;
+    pPlanner->nodes        = 0;
+    pPlanner->budget       = 0;
+    pPlanner->done         = 0;
+}
+
+/** Goes on with the next depth of the planning, if any: the plans of the
+ *  best situations of the depth */
+static void aiPlanNextDepth(tAiPlanner *pPlanner)
+{
+    const tEngObject *pObject;  /*  solid placed on the depth */
+    tEngSpace *pSpace;          /*  space of the plan expanded */
+    tAiChild *pBest;
+    tAiPlan *pSwap;
+    tEngPlacement placement;
+    int k;
+
+    /*  no plan can go on, or the depth, the preview or the budget
+        reached */
+    if (   (pPlanner->bestNum == 0)
+        || (pPlanner->depth == aiBeamDepth)
+        || (pPlanner->depth == pPlanner->previewNum)
+        || pPlanner->budget)
+    {
+        pPlanner->done = 1;
+        return;
+    }
+
+    pObject = (pPlanner->depth == 0) ? &pPlanner->object
+              : &pPlanner->preview[pPlanner->depth - 1];
+
+    for (k = 0; k < pPlanner->bestNum; k++)
+    {
+        pBest  = &pPlanner->best[k];
+        pSpace = (pPlanner->depth == 0) ? &pPlanner->space
+                 : &pPlanner->pPlans[pBest->parent].space;
+
+        pPlanner->pNext[k].root = (pPlanner->depth == 0) ? pBest->situ
+                                  : pPlanner->pPlans[pBest->parent].root;
+        engCopySpace(&pPlanner->pNext[k].space, pSpace);
+        aiPlaceSitu(pBest->situ, pObject, pBest->pOrients,
+                    &placement, &pPlanner->pNext[k].space);
+    }
+
+    pSwap              = pPlanner->pPlans;
+    pPlanner->pPlans   = pPlanner->pNext;
+    pPlanner->pNext    = pSwap;
+    pPlanner->planNum  = pPlanner->bestNum;
+    pPlanner->bestNum  = 0;
+    pPlanner->plan     = 0;
+    pPlanner->situNum  = -1;
+    pPlanner->depth++;
+}
+
+/** Continues planning the placement of the solid, looking ahead to the
+ *  coming ones, until the plan is done or the time is up. The
+ *  situations are searched in chunks fitting in the time left by the
+ *  time a situation took lately, at least AIMINCHUNK of them even if the
+ *  time is up at the call.
+ *
+ *  The best aiBeamWidth plans are kept on each depth; they are expanded
+ *  by every situation of the next solid, the best plans first, until
+ *  aiBeamDepth solids are planned or the next expansion would exceed
+ *  the budget of aiBeamNodes situations. The plans the next solid does
+ *  not fit in are dropped. The plans are scored by the space after
+ *  their last placement, the equal ones kept in the order of the
+ *  search, so the plan does not depend on the number of threads nor on
+ *  the time given. The best plan so far is kept in bestSitu.
+ *  \return 1 if the plan is done, 0 if to be continued */
+static int aiPlanRun(tAiPlanner *pPlanner, uint64_t deadline)
+{
+    const tEngObject *pObject;  /*  solid placed on the depth */
+    tEngSpace *pSpace;          /*  space of the plan expanded */
+    tAiChild child;
+    double bestScore;
+    uint64_t start, chunk;
+    int k, n, last;
+
+    while (!pPlanner->done)
+    {
+        /*  the depth done */
+        if (pPlanner->plan == pPlanner->planNum)
+        {
+            aiPlanNextDepth(pPlanner);
+            continue;
+        }
+
+        /*  the solid planned for in the space of the planner */
+        pObject = (pPlanner->depth == 0) ? &pPlanner->object
+                  : &pPlanner->preview[pPlanner->depth - 1];
+        pSpace  = (pPlanner->depth == 0) ? &pPlanner->space
+                  : &pPlanner->pPlans[pPlanner->plan].space;
+
+        /*  start expanding the next plan */
+        if (pPlanner->situNum < 0)
+        {
+            if (pPlanner->depth == 0)
+            {
+                pPlanner->pOrients = pPlanner->pRootOrients;
+            }
+            else if (engOverlapping(pObject, pSpace))
+            {
+                pPlanner->plan++;
+                continue;
+            }
+            else
+            {
+                pPlanner->pOrients = aiGetOrients(pObject, pSpace);
+            }
+
+            n = aiSituNum(pPlanner->pOrients, pSpace);
+
+            if (   (pPlanner->depth > 0)
+                && (pPlanner->nodes + n > aiBeamNodes))
+            {
+                pPlanner->budget = 1;
+                pPlanner->plan   = pPlanner->planNum;
+                continue;
+            }
+
+            if (n > pPlanner->scoresSize)
+            {
+                free(pPlanner->pScores);
+                pPlanner->scoresSize = n;
+                pPlanner->pScores    = malloc(n * sizeof(double));
+                if (pPlanner->pScores == NULL)
+                {
+                    fprintf(stderr, "Out of memory for the lookahead\n");
+                    exit(1);
+                }
+            }
+
+            pPlanner->nodes  += n;
+            pPlanner->situNum = n;
+            pPlanner->situ    = 0;
+        }
+
+        /*  search a chunk of its situations in the time left */
+        start = prfNow();
+        chunk = pPlanner->situNum - pPlanner->situ;
+
+        if (deadline != UINT64_MAX)
+        {
+            chunk = ((deadline > start) && (pPlanner->situTime > 0))
+                    ? (deadline - start) / pPlanner->situTime : 0;
+        }
+
+        chunk = (chunk < AIMINCHUNK) ? AIMINCHUNK : chunk;
+        last  = (chunk < (uint64_t)(pPlanner->situNum - pPlanner->situ))
+                ? pPlanner->situ + (int)chunk : pPlanner->situNum;
+
+        aiSearch(pPlanner->situ, last, pObject, pPlanner->pOrients, pSpace,
+                 pPlanner->pScores, &bestScore);
+
+        pPlanner->situTime = (prfNow() - start) / (last - pPlanner->situ);
+
+        /*  keep the best situations, the first of the equal ones */
+        for (n = pPlanner->situ; n < last; n++)
+        {
+            if (   (pPlanner->bestNum == aiBeamWidth)
+                && (   pPlanner->pScores[n]
+                    >= pPlanner->best[pPlanner->bestNum - 1].score))
+            {
+                continue;
+            }
+
+            child.parent   = pPlanner->plan;
+            child.situ     = n;
+            child.pOrients = pPlanner->pOrients;
+            child.score    = pPlanner->pScores[n];
+
+            k = (pPlanner->bestNum < aiBeamWidth) ? pPlanner->bestNum++
+                                                  : pPlanner->bestNum - 1;
+            for (; (k > 0) && (pPlanner->best[k - 1].score > child.score); k--)
+            {
+                pPlanner->best[k] = pPlanner->best[k - 1];
+            }
+            pPlanner->best[k] = child;
+        }
+
+        pPlanner->bestSitu = (pPlanner->depth == 0) ? pPlanner->best[0].situ
+                             : pPlanner->pPlans[pPlanner->best[0].parent].root;
+
+        pPlanner->situ = last;
+        if (last == pPlanner->situNum)
+        {
+            pPlanner->plan++;
+            pPlanner->situNum = -1;
+        }
+
+        if (prfNow() >= deadline)
+        {
+            break;
+        }
+    }
+
+    return(pPlanner->done);
+}
+
+/** Turns and moves needed to the best situation planned so far */
+static void aiPlanSteps(const tAiPlanner *pPlanner,
+                        int neededTurns[AITURNS],
+                        int neededMoves[ENGLEVELDIM])
+{
+    int i;
+    int situPos[ENGLEVELDIM];
+
+    aiSituation(pPlanner->bestSitu, pPlanner->pRootOrients, neededTurns,
+                situPos, &pPlanner->space);
+
+    for (i = 0; i < ENGLEVELDIM; i++)
+    {
+        neededMoves[i] = situPos[i] - pPlanner->object.pos[i];
+    }
+}
+
+/** Finds the best situation from all turn variation
+ *  (the most effective one with fewest turn), greedily or looking
+ *  ahead to the coming solids (see aiPlanRun()), planning at once.
+ *  \return id of optimal turn variation */
+int aiFindBestSolution(int neededTurns[AITURNS],
+                       int neededMoves[ENGLEVELDIM],
+                       tEngGame *pEngGame)
+{
+    int i;
+    int bestSitu;
+    tEngObject preview[ENGPREVIEW];
+    tAiPlanner planner;
+
+    for (i = 0; i < ENGPREVIEW; i++)
+    {
+        preview[i] = *engPeekSolid(i, pEngGame);
+    }
+
+    aiPlanInit(&planner);
+    aiPlanStart(&planner, &pEngGame->object, &pEngGame->space,
+                preview, ENGPREVIEW);
+    aiPlanRun(&planner, UINT64_MAX);
+    aiPlanSteps(&planner, neededTurns, neededMoves);
+
+    bestSitu = planner.bestSitu;
+    aiPlanFree(&planner);
+
+    return bestSitu;
+
+}  /*  End of function */
+
+/** Turns the object around the axices, then moves it to the position
+ *  on the level axices the same way as the auto gamer would do,
+ *  skipping the steps not possible. */
+static void aiPlaceObject(const int turns[AITURNS],
+                          const int pos[ENGLEVELDIM],
+                          tEngObject *pObject,
+                          const tEngSpace *pSpace)
+{
+    int i, j;
+    tEngObject stored;
+
+    for (j = 0; j < AITURNS; j++)
+    {
+        /*  Turn turns[j] times around j.th axle. */
+        for (i = 0; i < turns[j]; i++)
+        {
+            stored = *pObject;
+            pObject->orient = ortTurn(pObject->orient,
+                                      aiTurnAxices[j][0],
+                                      aiTurnAxices[j][1], 1);
+
+            if (engOverlapping(pObject, pSpace))
+            {
+                *pObject = stored;
+            }
+        }
+    }
+
+    for (j = 0; j < ENGLEVELDIM; j++)
+    {
+        stored = *pObject;
+        pObject->pos[j] = pos[j];
+
+        if (engOverlapping(pObject, pSpace))
+        {
+            *pObject = stored;
+        }
+    }
+}
+
+/** Evaluates the game space with the landed solid: the features of the
+ *  space in a pass over its levels and one over its columns, weighted.
+ *  The pass over the columns is left out if none of its features are
+ *  weighted.
+ *  \return score of the situation, the lower the better */
+static double aiProcessSitu(int cleared, const tEngSpace *pSpace)
+{
+    double feature[eAiFeatNum]; /*  features of the space */
+    double score = 0.0;         /*  weighted sum of the features */
+    double fill;                /*  fill of a level [0..1] */
+    double fillSum = 0.0;       /*  sum of the fills of the levels used */
+    double fillSum2 = 0.0;      /*  sum of their squares */
+    int coord[ENGLEVELDIM];     /*  coordinates of a column */
+    int l, n, axis, step;
+    long cog = 0;               /*  sum of the heights of the cells */
+    long height = 0;            /*  sum of the heights of the columns */
+    long rough = 0;             /*  sum of the height steps */
+
+    /*  For each level of gamespace, */
+    for (l = 0; l < pSpace->length; l++)
+    {
+        /*  add the position of its full cells to Cog, */
+        cog += (long)l * pSpace->levelFill[l];
+
+        /*  and its fill to the sums if it is used. */
+        if (l < pSpace->maxHeight)
+        {
+            fill      = (double)pSpace->levelFill[l] / pSpace->levelCells;
+            fillSum  += fill;
+            fillSum2 += fill * fill;
+        }
+    }
+
+    if (aiColumnFeatures)
+    {
+        memset(coord, 0, sizeof(coord));
+
+        /*  For each column, */
+        for (n = 0; n < pSpace->levelCells; n++)
+        {
+            height += pSpace->height[n];
+
+            /*  add the steps to the next columns along the axices. */
+            for (axis = 0; axis < ENGLEVELDIM; axis++)
+            {
+                if (coord[axis] + 1 < pSpace->size[axis])
+                {
+                    step = pSpace->height[n]
+                           - pSpace->height[n + pSpace->stride[axis]];
+                    rough += abs(step);
+                }
+            }
+
+            /*  Step to the next column, the last axis the fastest. */
+            for (axis = ENGLEVELDIM - 1;
+                 (axis >= 0) && (++coord[axis] == pSpace->size[axis]);
+                 axis--)
+            {
+                coord[axis] = 0;
+            }
+        }
+    }
+
+    /*  'Normalise' CoG, and the features of the columns per column. */
+    feature[eAiFeatCoG]       = (pSpace->filled == 0)
+                                ? 0.0 : (double)cog / pSpace->filled;
+    feature[eAiFeatHeight]    = (double)height / pSpace->levelCells;
+    feature[eAiFeatHoles]     = (double)(height - pSpace->filled)
+                                / pSpace->levelCells;
+    feature[eAiFeatCleared]   = cleared;
+    feature[eAiFeatVariance]  = (pSpace->maxHeight == 0)
+                                ? 0.0 : (fillSum2 - fillSum * fillSum
+                                         / pSpace->maxHeight)
+                                        / pSpace->maxHeight;
+    feature[eAiFeatRoughness] = (double)rough / pSpace->levelCells;
+    feature[eAiFeatMaxHeight] = pSpace->maxHeight;
+
+    for (n = 0; n < eAiFeatNum; n++)
+    {
+        score += aiWeights[n] * feature[n];
+    }
 
+    return(score);
 }  /*  End of function. */
@@ -7,12 +7,35 @@
 
 #define _AI_H_
 
+/*------------------------------------------------------------------------------
+   MACROS
+------------------------------------------------------------------------------*/
+
+/** Number of the planes the solids are turned in: the planes of the
+    neighbouring level axices and the plane of x and w */
+#if ENGDIM == 3
+#define AITURNS 2
+#elif ENGDIM == 4
+#define AITURNS 4
+#else
+#define AITURNS 5
+#endif
+
 /*------------------------------------------------------------------------------
    DECLARATIONS
 ------------------------------------------------------------------------------*/
 
 extern int aiIsActive(void);
 extern void aiSetActive(int active, tEngGame *pEngGame);
+extern void aiStep(tEngGame *pEngGame, int dt);
+extern int aiGetThreads(void);
+extern void aiSetThreads(int num);
+extern void aiLoadConf(void);
+extern void aiPlaceSolid(tEngGame *pEngGame);
+extern void aiFreeGamer(tEngGame *pEngGame);
+extern int aiFindBestSolution(int neededTurns[AITURNS],
+                              int neededMoves[ENGLEVELDIM],
+                              tEngGame *pEngGame);
 
 
 #endif
@@ -0,0 +1,347 @@
+/**
+ * \file  batch.c
+ * \brief Batch runner playing seeded games with the computer gamer.
+ *
+ *  Plays games concurrently in threads as fast as possible, without
+ *  graphics and timing, and reports the results of each game and the
+ *  throughput. Every thread plays its own games, nothing is shared but
+ *  the thread pool of the search of the computer gamer, if enabled.
+ *  The replays of the games can be written for ntris-replay, and the
+ *  performance counters of the engine summed over the games printed.
+ */
+
+/*------------------------------------------------------------------------------
+   INCLUDE FILES
+------------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <pthread.h>
+
+#include "m3d.h"
+#include "m4d.h"
+#include "rpl.h"
+#include "eng.h"
+#include "conf.h"
+#include "ai.h"
+
+/*------------------------------------------------------------------------------
+   TYPES
+------------------------------------------------------------------------------*/
+
+/** A game of the batch and its results */
+typedef struct
+{
+    tEngGame game;  /**< the game played */
+    int      pieces;/**< number of solids placed */
+} tBatchGame;
+
+/** Games played by a thread */
+typedef struct
+{
+    pthread_t   thread; /**< the thread */
+    tBatchGame *pGames; /**< all the games of the batch */
+    int         first;  /**< index of the first game of the thread */
+    int         step;   /**< index step to the next game of the thread */
+    int         num;    /**< number of games in the batch */
+} tBatchWorker;
+
+/*------------------------------------------------------------------------------
+   GLOBAL VARIABLES
+------------------------------------------------------------------------------*/
+
+/** number of games to be played */
+static int batchGames = 100;
+/** number of threads */
+static int batchThreads = 4;
+/** seed of the first game, the next ones get the following seeds */
+static unsigned long batchSeed = 1;
+/** difficulty level */
+static int batchDiff = 2;
+/** levels of the game space */
+static int batchLength = 12;
+/** level sizes of the game space, 0 for the default */
+static int batchSize[ENGLEVELDIM];
+/** a game is stopped after this number of solids */
+static int batchMaxPieces = 10000;
+/** directory of the replays written, NULL for not recording */
+static const char *batchReplays = NULL;
+/** flag of printing the performance counters of the engine */
+static int batchStats = 0;
+/** number of threads of the search of a move of the computer gamer */
+static int batchAiThreads = 1;
+
+/*------------------------------------------------------------------------------
+   PROTOTYPES
+------------------------------------------------------------------------------*/
+
+static void processARGV(int argc, char *argv[]);
+static void *batchWorker(void *param);
+static double batchSeconds(void);
+
+/*------------------------------------------------------------------------------
+   FUNCTIONS
+------------------------------------------------------------------------------*/
+
+/** Process command line arguments */
+static void processARGV(int argc, char *argv[])
+{
+    int i, axis;
+    char *pSize;
+    int valid;
+
+    for (i = 1; i < argc; i++)
+    {
+        if ((strcmp(argv[i], "--games") == 0) && (i + 1 < argc))
+        {
+            batchGames = atoi(argv[++i]);
+        }
+        else if ((strcmp(argv[i], "--threads") == 0) && (i + 1 < argc))
+        {
+            batchThreads = atoi(argv[++i]);
+        }
+        else if ((strcmp(argv[i], "--seed") == 0) && (i + 1 < argc))
+        {
+            batchSeed = strtoul(argv[++i], NULL, 0);
+        }
+        else if ((strcmp(argv[i], "--diff") == 0) && (i + 1 < argc))
+        {
+            batchDiff = atoi(argv[++i]);
+        }
+        else if ((strcmp(argv[i], "--length") == 0) && (i + 1 < argc))
+        {
+            batchLength = atoi(argv[++i]);
+        }
+        else if ((strcmp(argv[i], "--size") == 0) && (i + 1 < argc))
+        {
+            /*  comma separated sizes of the level axices */
+            pSize = argv[++i];
+            for (axis = 0; axis < ENGLEVELDIM; axis++)
+            {
+                batchSize[axis] = strtol(pSize, &pSize, 10);
+                if (*pSize == ',')
+                {
+                    pSize++;
+                }
+            }
+        }
+        else if ((strcmp(argv[i], "--pieces") == 0) && (i + 1 < argc))
+        {
+            batchMaxPieces = atoi(argv[++i]);
+        }
+        else if ((strcmp(argv[i], "--replays") == 0) && (i + 1 < argc))
+        {
+            batchReplays = argv[++i];
+        }
+        else if ((strcmp(argv[i], "--ai-threads") == 0) && (i + 1 < argc))
+        {
+            batchAiThreads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--stats") == 0)
+        {
+            batchStats = 1;
+        }
+        else if ((strcmp(argv[i], "--conf") == 0) && (i + 1 < argc))
+        {
+            confLoad(argv[++i]);
+            aiLoadConf();
+        }
+        else
+        {
+            fprintf(stderr,
+                    "usage: %s [--games N] [--threads N] [--seed N] [--diff 0..2]\n"
+                    "       [--length N] [--size X,Y,...] [--pieces N]\n"
+                    "       [--replays DIR] [--stats] [--ai-threads N]\n"
+                    "       [--conf FILE]\n",
+                    argv[0]);
+            exit(1);
+        }
+    }
+
+    valid =    (batchGames >= 0) && (batchThreads >= 1)
+            && (batchAiThreads >= 0)
+            && (batchDiff >= 0) && (batchDiff < DIFFLEVELS)
+            && (batchLength >= 2);
+
+    for (axis = 0; axis < ENGLEVELDIM; axis++)
+    {
+        if (batchSize[axis] == 0)
+        {
+            batchSize[axis] = 2;
+        }
+
+        valid &= (batchSize[axis] >= 2);
+    }
+
+    if (!valid)
+    {
+        fprintf(stderr, "%s: invalid parameter\n", argv[0]);
+        exit(1);
+    }
+}
+
+/** Wall clock time [sec] */
+static double batchSeconds(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return(ts.tv_sec + ts.tv_nsec * 1e-9);
+}
+
+/** Thread function playing the games of a worker */
+static void *batchWorker(void *param)
+{
+    tBatchWorker *pWorker = param;
+    tBatchGame *pGame;
+    int i;
+
+    for (i = pWorker->first; i < pWorker->num; i += pWorker->step)
+    {
+        pGame = &pWorker->pGames[i];
+
+        while (   (pGame->game.gameOver == 0)
+               && (pGame->pieces < batchMaxPieces))
+        {
+            aiPlaceSolid(&pGame->game);
+            pGame->pieces++;
+        }
+    }
+
+    return(NULL);
+}
+
+/** Main function of the batch runner */
+int main(int argc, char *argv[])
+{
+    int i, axis;
+    long pieces = 0;
+    char filename[1024];
+    tEngStats stats;
+    double start, elapsed;
+    tBatchGame *pGames;
+    tBatchWorker *pWorkers;
+
+    processARGV(argc, argv);
+
+    pGames   = malloc(batchGames * sizeof(tBatchGame));
+    pWorkers = malloc(batchThreads * sizeof(tBatchWorker));
+
+    if ((pGames == NULL) || (pWorkers == NULL))
+    {
+        fprintf(stderr, "%s: out of memory\n", argv[0]);
+        return(1);
+    }
+
+    /*  set up the games here, the shared tables of the engine
+        are built at the first initialisation */
+    for (i = 0; i < batchGames; i++)
+    {
+        tEngGame *pEngGame = &pGames[i].game;
+
+        engInitGame(pEngGame);
+
+        pEngGame->game_opts.diff   = batchDiff;
+        pEngGame->game_opts.seed   = batchSeed + i;
+        pEngGame->game_opts.record = (batchReplays != NULL);
+        pEngGame->spaceLength      = batchLength;
+
+        for (axis = 0; axis < ENGLEVELDIM; axis++)
+        {
+            pEngGame->size[axis]   = batchSize[axis];
+        }
+
+        engResetGame(pEngGame);
+
+        /*  count the score as of a user */
+        pEngGame->activeUser = 1;
+
+        /*  count the game played only */
+        engResetStats(pEngGame);
+
+        pGames[i].pieces = 0;
+    }
+
+    aiSetThreads(batchAiThreads);
+
+    start = batchSeconds();
+
+    for (i = 0; i < batchThreads; i++)
+    {
+        pWorkers[i].pGames = pGames;
+        pWorkers[i].first  = i;
+        pWorkers[i].step   = batchThreads;
+        pWorkers[i].num    = batchGames;
+
+        if (pthread_create(&pWorkers[i].thread, NULL,
+                           batchWorker, &pWorkers[i]) != 0)
+        {
+            fprintf(stderr, "%s: could not start thread\n", argv[0]);
+            return(1);
+        }
+    }
+
+    for (i = 0; i < batchThreads; i++)
+    {
+        pthread_join(pWorkers[i].thread, NULL);
+    }
+
+    elapsed = batchSeconds() - start;
+
+    printf("# game seed score pieces levels\n");
+
+    for (i = 0; i < batchGames; i++)
+    {
+        printf("%d %lu %d %d %d\n", i,
+               (unsigned long)pGames[i].game.seed,
+               pGames[i].game.score,
+               pGames[i].pieces,
+               pGames[i].game.levels);
+
+        pieces += pGames[i].pieces;
+    }
+
+    printf("# %dD, games %d, pieces %ld, threads %d, search threads %d, "
+           "%.3f s, %.2f games/s, %.1f pieces/s\n",
+           ENGDIM, batchGames, pieces, batchThreads, aiGetThreads(), elapsed,
+           (elapsed > 0) ? batchGames / elapsed : 0.0,
+           (elapsed > 0) ? pieces / elapsed : 0.0);
+
+    if (batchStats)
+    {
+        memset(&stats, 0, sizeof(stats));
+
+        for (i = 0; i < batchGames; i++)
+        {
+            engAddStats(&stats, &pGames[i].game.stats);
+        }
+
+        printf("# engine counters of the games\n");
+        engPrintStats(stdout, &stats);
+    }
+
+    for (i = 0; i < batchGames; i++)
+    {
+        if (batchReplays != NULL)
+        {
+            snprintf(filename, sizeof(filename), "%s/game%d.rpl",
+                     batchReplays, i);
+
+            if (rplSave(engEndReplay(&pGames[i].game), filename) != 0)
+            {
+                fprintf(stderr, "%s: cannot write %s\n", argv[0], filename);
+            }
+        }
+
+        engFreeGame(&pGames[i].game);
+    }
+
+    free(pGames);
+    free(pWorkers);
+
+    return(0);
+}
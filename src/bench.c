@@ -0,0 +1,453 @@
+/**
+ * \file  bench.c
+ * \brief Micro-benchmarks of the game engine and the computer gamer.
+ *
+ *  Measures the basic operations of the engine and the search of the
+ *  computer gamer on a matrix of space sizes and fill densities. The
+ *  spaces are filled at random from a fixed seed, so the runs are
+ *  comparable. Each case is warmed up, then timed in samples of a
+ *  number of operations; the median and the 99th percentile of the
+ *  time per operation of the samples are written as JSON.
+ */
+
+/*------------------------------------------------------------------------------
+   INCLUDE FILES
+------------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "m3d.h"
+#include "m4d.h"
+#include "rnd.h"
+#include "prf.h"
+#include "eng.h"
+#include "conf.h"
+#include "ai.h"
+
+/*------------------------------------------------------------------------------
+   MACROS
+------------------------------------------------------------------------------*/
+
+/** Number of the objects the overlap checks cycle through */
+#define BENCHOBJECTS 1024
+
+/*------------------------------------------------------------------------------
+   TYPES
+------------------------------------------------------------------------------*/
+
+/** Operations measured */
+typedef enum
+{
+    eBenchOverlap = 0,  /**< engOverlapping() */
+    eBenchTurn,         /**< engTurn() */
+    eBenchMove,         /**< engMove() */
+    eBenchLower,        /**< engLowerSolid() */
+    eBenchKill,         /**< engKillFullLevels() */
+    eBenchSearch,       /**< aiFindBestSolution() */
+    eBenchNum
+} tBenchOp;
+
+/** State of a case of the benchmark */
+typedef struct
+{
+    tEngGame   game;                    /**< game with the filled space */
+    tEngObject start;                   /**< solid at the top of the space */
+    tEngObject objects[BENCHOBJECTS];   /**< solids in the space */
+    tEngCells  gap;                     /**< the cell missing from the
+                                             bottom level */
+    int        next;                    /**< index of the next operation */
+} tBenchCase;
+
+/*------------------------------------------------------------------------------
+   CONSTANTS
+------------------------------------------------------------------------------*/
+
+/** Names of the operations */
+static const char *benchOpNames[eBenchNum] =
+{
+    "engOverlapping",
+    "engTurn",
+    "engMove",
+    "engLowerSolid",
+    "engKillFullLevels",
+    "aiFindBestSolution"
+};
+
+/** Level sizes and numbers of levels of the spaces */
+static const int benchSizes[][2] =
+{
+    {2, 12},
+    {4, 16},
+    {6, 20}
+};
+
+/** Rates of the cells filled in the lower half of the spaces */
+static const double benchDensities[] = {0.0, 0.3, 0.6};
+
+/*------------------------------------------------------------------------------
+   GLOBAL VARIABLES
+------------------------------------------------------------------------------*/
+
+/** seed of the random filling of the spaces */
+static unsigned long benchSeed = 1;
+/** number of the samples of a case */
+static int benchSamples = 101;
+/** shortest time of a sample [nsec] */
+static uint64_t benchSampleTime = 200000;
+/** time of the warm-up of a case [nsec] */
+static uint64_t benchWarmupTime = 20000000;
+/** longest time of the samples of a case, at least 11 of them taken [nsec] */
+static uint64_t benchMaxTime = 2000000000;
+/** time of reading the clock [nsec], subtracted from the timed calls */
+static uint64_t benchClockTime = 0;
+
+/*------------------------------------------------------------------------------
+   PROTOTYPES
+------------------------------------------------------------------------------*/
+
+static void processARGV(int argc, char *argv[]);
+static void benchSetup(tBenchCase *pCase, int size, int length,
+                       double density);
+static uint64_t benchRun(tBenchOp op, long num, tBenchCase *pCase);
+static int benchCompare(const void *pA, const void *pB);
+static void benchMeasure(tBenchOp op, int size, int length, double density,
+                         int first);
+
+/*------------------------------------------------------------------------------
+   FUNCTIONS
+------------------------------------------------------------------------------*/
+
+/** Process command line arguments */
+static void processARGV(int argc, char *argv[])
+{
+    int i;
+
+    for (i = 1; i < argc; i++)
+    {
+        if ((strcmp(argv[i], "--seed") == 0) && (i + 1 < argc))
+        {
+            benchSeed = strtoul(argv[++i], NULL, 0);
+        }
+        else if ((strcmp(argv[i], "--samples") == 0) && (i + 1 < argc))
+        {
+            benchSamples = atoi(argv[++i]);
+        }
+        else if ((strcmp(argv[i], "--sample-usec") == 0) && (i + 1 < argc))
+        {
+            benchSampleTime = strtoul(argv[++i], NULL, 0) * 1000;
+        }
+        else if ((strcmp(argv[i], "--ai-threads") == 0) && (i + 1 < argc))
+        {
+            aiSetThreads(atoi(argv[++i]));
+        }
+        else if ((strcmp(argv[i], "--conf") == 0) && (i + 1 < argc))
+        {
+            confLoad(argv[++i]);
+            aiLoadConf();
+        }
+        else
+        {
+            fprintf(stderr,
+                    "usage: %s [--seed N] [--samples N] [--sample-usec N]\n"
+                    "       [--ai-threads N] [--conf FILE]\n",
+                    argv[0]);
+            exit(1);
+        }
+    }
+
+    if (benchSamples < 1)
+    {
+        fprintf(stderr, "%s: invalid parameter\n", argv[0]);
+        exit(1);
+    }
+}
+
+/** Sets up a game with its lower half filled at random, the bottom level
+ *  but one cell, and the solids the operations work with */
+static void benchSetup(tBenchCase *pCase, int size, int length,
+                       double density)
+{
+    tEngGame *pEngGame = &pCase->game;
+    tEngSpace *pSpace = &pEngGame->space;
+    tEngPlacement placement;
+    tEngCells cells;
+    tRndState rnd;
+    int i, axis, w, n, fill;
+
+    engInitGame(pEngGame);
+
+    pEngGame->game_opts.seed   = benchSeed;
+    pEngGame->game_opts.record = 0;
+    pEngGame->spaceLength      = length;
+    for (axis = 0; axis < ENGLEVELDIM; axis++)
+    {
+        pEngGame->size[axis]   = size;
+    }
+
+    engResetGame(pEngGame);
+
+    rndSeed(&rnd, benchSeed);
+    cells.num = 1;
+
+    /*  the lower half but its bottom level, no level filled */
+    for (w = 1; w < length / 2; w++)
+    {
+        fill = density * pSpace->levelCells;
+        if (fill >= pSpace->levelCells)
+        {
+            fill = pSpace->levelCells - 1;
+        }
+
+        while (pSpace->levelFill[w] < fill)
+        {
+            for (axis = 0; axis < ENGLEVELDIM; axis++)
+            {
+                cells.c[0][axis] = rndRange(&rnd, size);
+            }
+            cells.c[0][ENGAXISW] = w;
+
+            if (!engGetCell(cells.c[0], pSpace))
+            {
+                engPlaceCells(&cells, &placement, pSpace);
+            }
+        }
+    }
+
+    /*  the bottom level full but one cell */
+    n = rndRange(&rnd, pSpace->levelCells);
+    for (i = 0; i < pSpace->levelCells; i++)
+    {
+        for (axis = ENGLEVELDIM - 1; axis >= 0; axis--)
+        {
+            cells.c[0][axis] = (i / pSpace->stride[axis]) % size;
+        }
+        cells.c[0][ENGAXISW] = 0;
+
+        if (i == n)
+        {
+            pCase->gap = cells;
+        }
+        else
+        {
+            engPlaceCells(&cells, &placement, pSpace);
+        }
+    }
+
+    /*  solids all over the space */
+    for (i = 0; i < BENCHOBJECTS; i++)
+    {
+        pCase->objects[i] = pEngGame->object;
+
+        for (axis = 0; axis < ENGLEVELDIM; axis++)
+        {
+            pCase->objects[i].pos[axis] = 1 + rndRange(&rnd, size - 1);
+        }
+        pCase->objects[i].pos[ENGAXISW] = 1 + rndRange(&rnd, length - 1);
+        pCase->objects[i].orient = rndRange(&rnd, ORTNUM);
+    }
+
+    pCase->start = pEngGame->object;
+    pCase->next  = 0;
+}
+
+/** Runs an operation a number of times
+ *  \return time spent in the operation [nsec] */
+static uint64_t benchRun(tBenchOp op, long num, tBenchCase *pCase)
+{
+    tEngGame *pEngGame = &pCase->game;
+    tEngPlacement placement;
+    int neededTurns[AITURNS];
+    int neededMoves[ENGLEVELDIM];
+    uint64_t start, elapsed, time = 0;
+    volatile int result = 0;
+    long i;
+    int k;
+
+    start = prfNow();
+
+    switch (op)
+    {
+    case eBenchOverlap:
+    {
+        for (i = 0; i < num; i++)
+        {
+            k = pCase->next++ % BENCHOBJECTS;
+            result += engOverlapping(&pCase->objects[k], &pEngGame->space);
+        }
+        break;
+    }
+    case eBenchTurn:
+    {
+        /*  turns forth and back in the planes of the level axices */
+        for (i = 0; i < num; i++)
+        {
+            k = pCase->next++;
+            result += engTurn((k / 2) % ENGLEVELDIM,
+                              (k / 2 + 1) % ENGLEVELDIM,
+                              (k % 2) ? -1 : 1, 1, pEngGame);
+        }
+        break;
+    }
+    case eBenchMove:
+    {
+        /*  moves forth and back along the level axices */
+        for (i = 0; i < num; i++)
+        {
+            k = pCase->next++;
+            result += engMove((k / 2) % ENGLEVELDIM,
+                              (k % 2) ? -1 : 1, pEngGame);
+        }
+        break;
+    }
+    case eBenchLower:
+    {
+        /*  lowers from the top, not landing */
+        for (i = 0; i < num; i++)
+        {
+            pEngGame->object = pCase->start;
+            result += engLowerSolid(pEngGame);
+        }
+        break;
+    }
+    case eBenchKill:
+    {
+        /*  fills the bottom level, times its deletion, then restores it */
+        for (i = 0; i < num; i++)
+        {
+            engFillCells(&pCase->gap, &placement, &pEngGame->space);
+
+            start = prfNow();
+            engKillFullLevels(&placement, &pEngGame->space);
+            elapsed = prfNow() - start;
+            time += (elapsed > benchClockTime) ? elapsed - benchClockTime : 0;
+
+            engUndoPlacement(&placement, &pEngGame->space);
+        }
+        return(time);
+    }
+    case eBenchSearch:
+    {
+        for (i = 0; i < num; i++)
+        {
+            result += aiFindBestSolution(neededTurns, neededMoves, pEngGame);
+        }
+        break;
+    }
+    default:
+        break;
+    }
+
+    return(prfNow() - start);
+}
+
+/** Orders the times of the samples */
+static int benchCompare(const void *pA, const void *pB)
+{
+    double a = *(const double *)pA;
+    double b = *(const double *)pB;
+
+    return((a > b) - (a < b));
+}
+
+/** Measures an operation on a space, prints the results as a JSON object */
+static void benchMeasure(tBenchOp op, int size, int length, double density,
+                         int first)
+{
+    static tBenchCase benchCase;
+    double *pSamples;
+    uint64_t start, total = 0;
+    long num = 1;
+    int i, samples;
+
+    benchSetup(&benchCase, size, length, density);
+
+    /*  warm up, finding the number of operations of a sample */
+    start = prfNow();
+    while (prfNow() - start < benchWarmupTime)
+    {
+        if (benchRun(op, num, &benchCase) < benchSampleTime)
+        {
+            num *= 2;
+        }
+    }
+
+    pSamples = malloc(benchSamples * sizeof(double));
+
+    for (samples = 0; samples < benchSamples; samples++)
+    {
+        if ((samples >= 11) && (total > benchMaxTime))
+        {
+            break;
+        }
+
+        start = prfNow();
+        pSamples[samples] = (double)benchRun(op, num, &benchCase) / num;
+        total += prfNow() - start;
+    }
+
+    qsort(pSamples, samples, sizeof(double), benchCompare);
+
+    i = (samples * 99 + 99) / 100 - 1;
+
+    printf("%s    {\"op\": \"%s\", \"size\": %d, \"length\": %d, "
+           "\"density\": %.2f, \"samples\": %d, \"ops_per_sample\": %ld, "
+           "\"ns_per_op_median\": %.1f, \"ns_per_op_p99\": %.1f, "
+           "\"ops_per_sec\": %.0f}",
+           first ? "" : ",\n",
+           benchOpNames[op], size, length, density, samples, num,
+           pSamples[samples / 2], pSamples[i],
+           (pSamples[samples / 2] > 0) ? 1e9 / pSamples[samples / 2] : 0.0);
+    fflush(stdout);
+
+    free(pSamples);
+    engFreeGame(&benchCase.game);
+}
+
+/** Main function of the benchmark */
+int main(int argc, char *argv[])
+{
+    int op, s, d, i;
+    uint64_t time;
+
+    processARGV(argc, argv);
+
+    /*  time of reading the clock, the least of some tries */
+    benchClockTime = ~(uint64_t)0;
+    for (i = 0; i < 1000; i++)
+    {
+        time = prfNow();
+        time = prfNow() - time;
+
+        if (time < benchClockTime)
+        {
+            benchClockTime = time;
+        }
+    }
+
+    printf("{\n  \"dim\": %d, \"seed\": %lu, \"clock_ns\": %llu, "
+           "\"ai_threads\": %d,\n  \"results\": [\n",
+           ENGDIM, benchSeed, (unsigned long long)benchClockTime,
+           aiGetThreads());
+
+    i = 1;
+    for (op = 0; op < eBenchNum; op++)
+    {
+        for (s = 0; s < (int)(sizeof(benchSizes) / sizeof(benchSizes[0])); s++)
+        {
+            for (d = 0;
+                 d < (int)(sizeof(benchDensities) / sizeof(benchDensities[0]));
+                 d++)
+            {
+                benchMeasure(op, benchSizes[s][0], benchSizes[s][1],
+                             benchDensities[d], i);
+                i = 0;
+            }
+        }
+    }
+
+    printf("\n  ]\n}\n");
+
+    return(0);
+}
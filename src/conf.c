@@ -11,6 +11,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <stdint.h>
 
 #include "conf.h"
 
@@ -24,13 +25,16 @@
 
 static char**  confKeys = NULL;
 static double* confVals = NULL;
+/** values as written in the file, to be read and saved exactly */
+static char**  confTexts = NULL;
 static int     confNum = 0;
 
 /*------------------------------------------------------------------------------
    PROTOTYPES
 ------------------------------------------------------------------------------*/
 
-static void confAddVar(char *name, double value);
+static void confPutVar(char *name, double value, const char *text);
+static void confAddVar(char *name, double value, const char *text);
 
 /*------------------------------------------------------------------------------
    FUNCTIONS
@@ -61,7 +65,9 @@ void confLoad(char *filename)
     FILE *file = NULL;
     char name[256];
     char line[256];
-    float value;
+    char text[256];
+    char *end;
+    double value;
 
     file = fopen(filename, "r");
 
@@ -69,9 +75,13 @@ void confLoad(char *filename)
     {
         while(fgets(line, sizeof(line), file) != NULL)
         {
-            if (sscanf(line, "%s = %f", name, &value) == 2)
+            if (sscanf(line, "%255s = %255s", name, text) == 2)
             {
-                confSetVar((char *)name, value);
+                value = strtod(text, &end);
+                if (end != text)
+                {
+                    confPutVar((char *)name, value, text);
+                }
             }
         }
         fclose(file);
@@ -94,7 +104,36 @@ double confGetVar(char *name, int *exists)
     return(0);
 }
 
+/** Unsigned integer value of a variable, read exactly from its text
+ *  (seeds and the like, beyond the precision of a double) */
+uint64_t confGetUnsigned(char *name, int *exists)
+{
+    int i;
+    *exists = 0;
+
+    for(i = 0; i < confNum; i++)
+    {
+        if (strcmp(confKeys[i], name) == 0)
+        {
+            *exists = (confVals[i] >= 0);
+            return(*exists ? strtoull(confTexts[i], NULL, 0) : 0);
+        }
+    }
+    return(0);
+}
+
 void confSetVar(char *name, double value)
+{
+    char text[32];
+
+    /*  enough digits to read back the same double */
+    snprintf(text, sizeof(text), "%.17g", value);
+
+    confPutVar(name, value, text);
+}
+
+/** Sets a variable to a value and its text */
+static void confPutVar(char *name, double value, const char *text)
 {
     int i;
     int exists = 0;
@@ -104,35 +143,44 @@ void confSetVar(char *name, double value)
         if (strcmp(confKeys[i], name) == 0)
         {
             confVals[i] = value;
+            free(confTexts[i]);
+            confTexts[i] = malloc(strlen(text)+1);
+            strcpy(confTexts[i], text);
             exists = 1;
         }
     }
 
     if (!exists)
     {
-        confAddVar(name, value);
+        confAddVar(name, value, text);
     }
 }
 
-static void confAddVar(char *name, double value)
+static void confAddVar(char *name, double value, const char *text)
 {
     char** tempConfKeys = malloc((confNum+1) * sizeof(char*));
     double* tempConfVals = malloc((confNum+1) * sizeof(double));
+    char** tempConfTexts = malloc((confNum+1) * sizeof(char*));
 
     if(confNum > 0)
     {
         memcpy(tempConfKeys, confKeys, confNum * sizeof(char*));
         memcpy(tempConfVals, confVals, confNum * sizeof(double));
+        memcpy(tempConfTexts, confTexts, confNum * sizeof(char*));
         free(confKeys);
         free(confVals);
+        free(confTexts);
     }
     confNum++;
 
     confKeys = tempConfKeys;
     confVals = tempConfVals;
+    confTexts = tempConfTexts;
     confKeys[confNum-1] = malloc(strlen(name)+1);
     strcpy(confKeys[confNum-1], name);
     confVals[confNum-1] = value;
+    confTexts[confNum-1] = malloc(strlen(text)+1);
+    strcpy(confTexts[confNum-1], text);
 }
 
 void confSave(char *filename)
@@ -146,7 +194,7 @@ void confSave(char *filename)
     {
         for(i = 0; i < confNum; i++)
         {
-            fprintf(file, "%s = %g\n",confKeys[i], confVals[i]);
+            fprintf(file, "%s = %s\n",confKeys[i], confTexts[i]);
         }
         fclose(file);
     }
@@ -7,6 +7,12 @@
 
 #define _CONF_H_
 
+/*------------------------------------------------------------------------------
+   INCLUDES
+------------------------------------------------------------------------------*/
+
+#include <stdint.h>
+
 /*------------------------------------------------------------------------------
    DECLARATIONS
 ------------------------------------------------------------------------------*/
@@ -16,5 +22,6 @@ extern void confLoad(char *filename);
 extern void confSave(char *filename);
 extern void confSetVar(char *name, double value);
 extern double confGetVar(char *name, int *exists);
+extern uint64_t confGetUnsigned(char *name, int *exists);
 
 #endif
@@ -11,94 +11,161 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <time.h>
 #include <math.h>
+#include <limits.h>
 
-#include "timer.h"
 #include "m.h"
 #include "m3d.h"
 #include "m4d.h"
+#include "ort.h"
+#include "rpl.h"
+#include "prf.h"
 #include "eng.h"
 
 /*------------------------------------------------------------------------------
    MACROS
 ------------------------------------------------------------------------------*/
 
-/** number of type of objects */
-#define OBJECTTYPES (6)
+/** number of type of objects, number of the level axices
+    the shapes of the objects are defined on */
+#define OBJECTTYPES ENGOBJECTTYPES
+#if ENGDIM == 3
+#define SHAPEDIM (2)
+#else
+#define SHAPEDIM (3)
+#endif
+
+/** words of level w of a space */
+#define ENGLEVEL(pSpace, w) ((pSpace)->level + (size_t)(w) * (pSpace)->levelWords)
+/** get the cell with bit index n of a level */
+#define ENGGETCELL(pLevel, n) (((pLevel)[(n) / 64] >> ((n) % 64)) & 1)
+/** set the cell with bit index n of a level */
+#define ENGSETCELL(pLevel, n) ((pLevel)[(n) / 64] |= (uint64_t)1 << ((n) % 64))
+/** clear the cell with bit index n of a level */
+#define ENGCLEARCELL(pLevel, n) ((pLevel)[(n) / 64] &= ~((uint64_t)1 << ((n) % 64)))
+/** get a cell of a space */
+#define ENGSPACECELL(pSpace, cell) \
+    ENGGETCELL(ENGLEVEL(pSpace, (cell)[ENGAXISW]), engLevelIndex(cell, pSpace))
 
 /*------------------------------------------------------------------------------
   CONSTANTS
 ------------------------------------------------------------------------------*/
 
-/** Time step for animation [msec] */
-static const int engAnimationTimeStep = 15;
-/** Time step for step downs when object dropped [msec] */
-static const double engDropSolidTimeStep = 10;
 
-/** Empty solid */
-static const tEngSolid engEmptySolid =
-{   {{{{0,0}, {0,0}}, {{0,0}, {0,0}}}, {{{0,0}, {0,0}}, {{0,0}, {0,0}}}}   };
-
-/** defined solids */
-static const tEngBlocks engObjects[OBJECTTYPES] =
+/** defined solids: centers of their blocks relative to the object
+    position in half cells on the first level axices; the centers are
+    at +1 on the rest of the level axices and at -1 on w */
+static const struct
 {
-    /*  num 1.,3. x    y    z    w  2.,4.  x    y    z    w */
-    {
-        1, { {{ 0.5, 0.5, 0.5,-0.5}}, {{ 0.0, 0.0, 0.0, 0.0}},
-            {{ 0.0, 0.0, 0.0, 0.0}}, {{ 0.0, 0.0, 0.0, 0.0}}
-        }
-    }, /*   . */
-    {
-        2, { {{ 0.5, 0.5, 0.5,-0.5}}, {{ 0.5, 0.5,-0.5,-0.5}},
-            {{ 0.0, 0.0, 0.0, 0.0}}, {{ 0.0, 0.0, 0.0, 0.0}}
-        }
-    }, /*   : */
-    {
-        3, { {{ 0.5, 0.5, 0.5,-0.5}}, {{ 0.5, 0.5,-0.5,-0.5}},
-            {{ 0.5,-0.5, 0.5,-0.5}}, {{ 0.0, 0.0, 0.0, 0.0}}
-        }
-    }, /*   :. */
-    {
-        4, { {{ 0.5, 0.5, 0.5,-0.5}}, {{ 0.5, 0.5,-0.5,-0.5}},
-            {{ 0.5,-0.5, 0.5,-0.5}}, {{ 0.5,-0.5,-0.5,-0.5}}
-        }
-    }, /*   :: */
-    {
-        4, { {{ 0.5, 0.5, 0.5,-0.5}}, {{ 0.5, 0.5,-0.5,-0.5}},
-            {{ 0.5,-0.5, 0.5,-0.5}}, {{-0.5, 0.5,-0.5,-0.5}}
-        }
-    }, /*  ':. */
-    {
-        4, { {{ 0.5, 0.5, 0.5,-0.5}}, {{ 0.5, 0.5,-0.5,-0.5}},
-            {{ 0.5,-0.5, 0.5,-0.5}}, {{-0.5, 0.5, 0.5,-0.5}}
-        }
-    }, /*  ,:. */
+    int num;                               /**< Number of blocks */
+    signed char c[MAXBLOCKNUM][SHAPEDIM];  /**< Block centers */
+} engObjects[OBJECTTYPES] =
+{
+#if ENGDIM == 3
+    /*  num 1.  x   y   2.  x   y   3.  x   y   4.  x   y */
+    {1, { { 1, 1}, { 0, 0}, { 0, 0}, { 0, 0} } }, /*   . */
+    {2, { { 1, 1}, { 1,-1}, { 0, 0}, { 0, 0} } }, /*   : */
+    {3, { { 1, 1}, { 1,-1}, {-1, 1}, { 0, 0} } }, /*   :. */
+    {4, { { 1, 1}, { 1,-1}, {-1, 1}, {-1,-1} } }, /*   :: */
+#else
+    /*  num 1.  x   y   z   2.  x   y   z   3.  x   y   z   4.  x   y   z */
+    {1, { { 1, 1, 1}, { 0, 0, 0}, { 0, 0, 0}, { 0, 0, 0} } }, /*   . */
+    {2, { { 1, 1, 1}, { 1, 1,-1}, { 0, 0, 0}, { 0, 0, 0} } }, /*   : */
+    {3, { { 1, 1, 1}, { 1, 1,-1}, { 1,-1, 1}, { 0, 0, 0} } }, /*   :. */
+    {4, { { 1, 1, 1}, { 1, 1,-1}, { 1,-1, 1}, { 1,-1,-1} } }, /*   :: */
+    {4, { { 1, 1, 1}, { 1, 1,-1}, { 1,-1, 1}, {-1, 1,-1} } }, /*  ':. */
+    {4, { { 1, 1, 1}, { 1, 1,-1}, { 1,-1, 1}, {-1, 1, 1} } }, /*  ,:. */
+#endif
 };
 
 /** probabilities of solids in different
     difficulty levels (easy, medium, hard) */
 static const int engProbs[DIFFLEVELS][OBJECTTYPES] =
 {
+#if ENGDIM == 3
+    {10, 5, 5, 1},
+    { 5, 3, 2, 1},
+    { 2, 1, 1, 1}
+#else
     {10, 5, 5, 1, 1, 1},
     { 5, 3, 2, 1, 1, 1},
     { 2, 1, 1, 1, 1, 1}
+#endif
 };
 
+/** names of the counters and the timed calls printed */
+static const char *engCounterNames[eEngCountNum] =
+{
+    "overlap checks",
+    "turns",
+    "turns rejected",
+    "moves",
+    "moves rejected",
+    "locks",
+    "levels cleared",
+    "new solids"
+};
+static const char *engTimerNames[eEngTimeNum] =
+{
+    "lower",
+    "turn",
+    "move",
+    "kill levels"
+};
+
+/*------------------------------------------------------------------------------
+   GLOBAL VARIABLES
+------------------------------------------------------------------------------*/
+
+/** flag for engine tables already built */
+static int engTablesInitialized = 0;
+
+/** alias tables of the solid probabilities in the difficulty levels */
+static tRndAlias engProbAlias[DIFFLEVELS];
+
+/** cell offsets of the blocks relative to the object position
+    by object type and orientation */
+static signed char engOrientCells[OBJECTTYPES][ORTNUM][MAXBLOCKNUM][ENGDIM];
+
+#if ENGDIM == 4
+/** block centers of the objects displayed */
+static tEngBlocks engBlocks[OBJECTTYPES];
+#endif
+
 /*------------------------------------------------------------------------------
    PROTOTYPES
 ------------------------------------------------------------------------------*/
 
-static tEngSolid engObject2Solid(tEngObject object, int *invalid, tEngGame *pEngGame);
-static int engEqLevel(tEngLevel level1, int value, tEngGame *pEngGame);
-static void engCopyLevel(tEngLevel target, tEngLevel source, tEngGame *pEngGame);
-static void engClearLevel(tEngLevel level, tEngGame *pEngGame);
+static void engInitTables(void);
+static int engBlockCenter(int type, int block, int axis);
+static int engLevelIndex(const int cell[ENGDIM], const tEngSpace *pSpace);
+#if ENGDIM == 4
+static tM4dMatrix engOrientMatrix(int orient);
+static tM4dVector engPosVector(const int pos[ENGDIM]);
+#endif
+static int engRandOrient(tEngGame *pEngGame);
+static int engCellInSpace(const int cell[ENGDIM], const tEngSpace *pSpace);
+static void engAllocSpace(tEngSpace *pSpace, int length,
+                          const int size[ENGLEVELDIM]);
+static void engResetSpace(tEngSpace *pSpace, int length,
+                          const int size[ENGLEVELDIM]);
+static void engGenerateSolid(tEngObject *pObject, tEngGame *pEngGame);
 static void engNewSolid(tEngGame *pEngGame);
-static int engOverlapping(tEngGame *pEngGame);
-static void engKillFullLevels(tEngGame *pEngGame);
-static int engAnimation(int interval, tEngGame *pEngGame);
-static int engDropSolidTimer(int interval, tEngGame *pEngGame);
-static int engTimer(int interval, tEngGame *pEngGame);
+static void engUpdateHeights(tEngSpace *pSpace);
+static void engMotion(const tEngObject *pFrom, int axis1, int axis2,
+                      int sign, tEngGame *pEngGame);
+static int engLower(tEngGame *pEngGame);
+static int engFlags(const tEngGame *pEngGame);
+static void engRecord(tRplOpType type, int arg0, int arg1, int arg2,
+                      tEngGame *pEngGame);
+static uint64_t engHashBytes(uint64_t hash, const void *pData, size_t size);
+static void engLandSolid(tEngGame *pEngGame);
+static int engSolidOverlapping(tEngGame *pEngGame);
+static void engEvent(tEngEventType type, int num, const int *pArg, int argNum,
+                     tEngGame *pEngGame);
+static void engTimer(tEngGame *pEngGame);
 static int engGetTimestep(tEngGame *pEngGame);
 static void engUpdateScore(int clearedLevels, tEngGame *pEngGame);
 
@@ -106,26 +173,126 @@ static void engUpdateScore(int clearedLevels, tEngGame *pEngGame);
    FUNCTIONS
 ------------------------------------------------------------------------------*/
 
-/** get the cell of the level at x, y, z from
-    the game space empty or full */
-int engGetSpaceCell(int w, int x, int y, int z, tEngGame *pEngGame)
+/** Center of a block of an object on an axis in half cells */
+static int engBlockCenter(int type, int block, int axis)
 {
-    return(pEngGame->space[w][x][y][z]);
+    return((axis < SHAPEDIM) ? engObjects[type].c[block][axis] :
+           (axis < ENGAXISW) ? 1 :
+           -1);
 }
 
-/** Calculates scores for cleared levels */
-static void engUpdateScore(int clearedLevels, tEngGame *pEngGame)
+/** Builds the cell offset table of the objects in every orientation */
+static void engInitTables(void)
 {
-    int score = 100;
-    int clearSpace = 1;
-    int level;
+    int type, orient, i, row, diff;
 
-    for(level = 0; level < pEngGame->spaceLength; level++)
+    if (engTablesInitialized)
     {
-        clearSpace &= engEqLevel(pEngGame->space[level], 0, pEngGame);
+        return;
     }
 
-    if (clearSpace)
+    ortInit();
+
+    for (diff = 0; diff < DIFFLEVELS; diff++)
+    {
+        rndInitAlias(&engProbAlias[diff], engProbs[diff], OBJECTTYPES);
+    }
+
+    for (type = 0; type < OBJECTTYPES; type++)
+        for (orient = 0; orient < ORTNUM; orient++)
+            for (i = 0; i < engObjects[type].num; i++)
+                for (row = 0; row < ENGDIM; row++)
+                {
+                    /*  rotated block center is at +/-1 half cell, */
+                    /*  its cell is the floor of it */
+                    engOrientCells[type][orient][i][row] =
+                        (ortSign(orient, row)
+                         * engBlockCenter(type, i, ortAxis(orient, row)) - 1) / 2;
+                }
+
+#if ENGDIM == 4
+    for (type = 0; type < OBJECTTYPES; type++)
+    {
+        engBlocks[type].num = engObjects[type].num;
+
+        for (i = 0; i < MAXBLOCKNUM; i++)
+        {
+            for (row = 0; row < ENGDIM; row++)
+            {
+                engBlocks[type].c[i].c[row] = (i < engObjects[type].num)
+                                              ? engBlockCenter(type, i, row) / 2.0
+                                              : 0.0;
+            }
+        }
+    }
+#endif
+
+    engTablesInitialized = 1;
+}
+
+/** Index of the cell of a level: its bit in the level and
+    its column in the height map */
+static int engLevelIndex(const int cell[ENGDIM], const tEngSpace *pSpace)
+{
+    int axis;
+    int index = 0;
+
+    for (axis = 0; axis < ENGLEVELDIM; axis++)
+    {
+        index += cell[axis] * pSpace->stride[axis];
+    }
+
+    return(index);
+}
+
+/** get a cell of the space empty or full */
+int engGetCell(const int cell[ENGDIM], const tEngSpace *pSpace)
+{
+    return(ENGSPACECELL(pSpace, cell));
+}
+
+#if ENGDIM == 4
+
+/** Axices matrix of an orientation */
+static tM4dMatrix engOrientMatrix(int orient)
+{
+    int row;
+    tM4dMatrix axices = m4dNullMatrix();
+
+    for (row = 0; row < eM4dDimNum; row++)
+    {
+        axices.c[row][ortAxis(orient, row)] = ortSign(orient, row);
+    }
+
+    return(axices);
+}
+
+/** Vector of a cell position */
+static tM4dVector engPosVector(const int pos[ENGDIM])
+{
+    return(m4dVector(pos[eM4dAxisX], pos[eM4dAxisY],
+                     pos[eM4dAxisZ], pos[eM4dAxisW]));
+}
+
+/** get the block definitions, the position and the axices of a solid */
+const tEngBlocks *engGetSolidPose(tM4dVector *pPos, tM4dMatrix *pAxices,
+                                  const tEngObject *pObject)
+{
+    *pPos    = engPosVector(pObject->pos);
+    *pAxices = engOrientMatrix(pObject->orient);
+
+    return(&engBlocks[pObject->type]);
+}
+
+#endif /* ENGDIM == 4 */
+
+/** Calculates scores for cleared levels */
+static void engUpdateScore(int clearedLevels, tEngGame *pEngGame)
+{
+    int score = 100;
+
+    /*  whole space cleared */
+    if (pEngGame->space.filled == 0)
     {
         score *= 2;
     }
@@ -135,61 +302,188 @@ static void engUpdateScore(int clearedLevels, tEngGame *pEngGame)
     score *= pow(clearedLevels, 2);
 
     /*  increase score if user plays */
-    if (pEngGame->activeUser)
+    if (pEngGame->activeUser && (score > 0))
     {
         pEngGame->score += score;
+
+        engEvent(eEngEventScore, pEngGame->score, &score, 1, pEngGame);
     }
 }
 
 
-/** time step, while the solid steps one level down in msec; */
+/** time step, while the solid steps one level down in msec;
+ *  at least 1, for engStep() to get to the end of its time */
 static int engGetTimestep(tEngGame *pEngGame)
 {
     /*  calculate timestep depending on actual score */
-    return(10000/(4+pEngGame->score/2000));
+    int timestep = 10000/(4+pEngGame->score/2000);
+
+    return((timestep < 1) ? 1 : timestep);
 }
 
-/** Drop object */
-void engDropSolid(tEngGame *pEngGame)
+/** Advances the engine clock by dt msec, lowering the solid
+ *  when due in the meantime. */
+void engStep(tEngGame *pEngGame, int dt)
 {
-    pEngGame->fnID_dropdown =
-        setTimerCallback(1, (tTimerCallback)engDropSolidTimer, pEngGame);
+    long end = pEngGame->time + dt;
+
+    /*  record the flags changed since the last step */
+    engRecord(eRplOpFlags, engFlags(pEngGame), 0, 0, pEngGame);
+
+    while (   (pEngGame->lowerTime != ENGNOTIME)
+           && (pEngGame->lowerTime <= end))
+    {
+        pEngGame->time = pEngGame->lowerTime;
+
+        engTimer(pEngGame);
+    }
+
+    pEngGame->time = end;
 }
 
-/** Timer for drop object */
-static int engDropSolidTimer(int interval, tEngGame *pEngGame)
+/** Queues an event with the actual solid, dropped if the ring is full
+ *  (producer side, the engine only). The last slot is kept for the end
+ *  of the game, never to be dropped. */
+static void engEvent(tEngEventType type, int num, const int *pArg, int argNum,
+                     tEngGame *pEngGame)
 {
-    if (engLowerSolid(pEngGame))
+    tEngEventRing *pRing = &pEngGame->events;
+    unsigned head = atomic_load_explicit(&pRing->head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&pRing->tail, memory_order_acquire);
+    tEngEvent *pEvent;
+    int i;
+
+    if (head - tail >= ((type == eEngEventGameOver) ? ENGEVENTS
+                                                    : ENGEVENTS - 1))
     {
-        interval = engDropSolidTimeStep;
+        pRing->lost++;
+        return;
     }
-    else
+
+    pEvent = &pRing->event[head % ENGEVENTS];
+
+    pEvent->type   = type;
+    pEvent->time   = pEngGame->time;
+    pEvent->object = pEngGame->object;
+    pEvent->num    = num;
+
+    for (i = 0; i < MAXBLOCKNUM; i++)
+    {
+        pEvent->arg[i] = (i < argNum) ? pArg[i] : 0;
+    }
+
+    /*  publish the event after its contents */
+    atomic_store_explicit(&pRing->head, head + 1, memory_order_release);
+}
+
+/** Takes the oldest event of the game (consumer side, drained by one
+ *  reader each frame)
+ *  \return 1 if got one, 0 if none queued */
+int engPollEvent(tEngEvent *pEvent, tEngGame *pEngGame)
+{
+    tEngEventRing *pRing = &pEngGame->events;
+    unsigned tail = atomic_load_explicit(&pRing->tail, memory_order_relaxed);
+    unsigned head = atomic_load_explicit(&pRing->head, memory_order_acquire);
+
+    if (head == tail)
+    {
+        return(0);
+    }
+
+    *pEvent = pRing->event[tail % ENGEVENTS];
+
+    /*  free the slot after copying it */
+    atomic_store_explicit(&pRing->tail, tail + 1, memory_order_release);
+
+    return(1);
+}
+
+/** Clears the performance counters of the game */
+void engResetStats(tEngGame *pEngGame)
+{
+    memset(&pEngGame->stats, 0, sizeof(tEngStats));
+}
+
+/** Adds the performance counters of a game to a sum */
+void engAddStats(tEngStats *pSum, const tEngStats *pStats)
+{
+    int i;
+
+    for (i = 0; i < eEngCountNum; i++)
     {
-        pEngGame->fnID_dropdown = NULL;
-        interval = 0;
+        pSum->count[i] += pStats->count[i];
     }
 
-    return(interval);
+    for (i = 0; i < eEngTimeNum; i++)
+    {
+        prfHistMerge(&pSum->time[i], &pStats->time[i]);
+    }
+}
+
+/** Prints the performance counters, then the durations of the timed calls */
+void engPrintStats(FILE *file, const tEngStats *pStats)
+{
+    int i;
+
+    for (i = 0; i < eEngCountNum; i++)
+    {
+        fprintf(file, "%-16s %10llu\n", engCounterNames[i],
+                (unsigned long long)pStats->count[i]);
+    }
+
+    fprintf(file, "%-16s %10s %10s %10s %10s %10s\n",
+            "[nsec]", "calls", "mean", "p50", "p99", "max");
+
+    for (i = 0; i < eEngTimeNum; i++)
+    {
+        prfHistPrint(file, engTimerNames[i], &pStats->time[i]);
+    }
+}
+
+/** Drops the solid at once to where it lands and puts it to the space.
+ *  The fall is left to the display to show (see drop). */
+void engDropSolid(tEngGame *pEngGame)
+{
+    int distance;
+
+    engRecord(eRplOpDrop, 0, 0, 0, pEngGame);
+
+    if (pEngGame->gameOver)
+    {
+        return;
+    }
+
+    distance = engDropDistance(&pEngGame->object, &pEngGame->space);
+
+    pEngGame->drop.object   = pEngGame->object;
+    pEngGame->drop.distance = distance;
+    pEngGame->drop.time     = pEngGame->time;
+
+    /*  the space without the solid and with the levels it clears */
+    engCopySpace(&pEngGame->drop.space, &pEngGame->space);
+
+    pEngGame->object.pos[ENGAXISW] -= distance;
+    pEngGame->motion.time = ENGNOTIME;
+
+    engLandSolid(pEngGame);
 }
 
 /** Timer function for Game engine. */
-static int engTimer(int interval, tEngGame *pEngGame)
+static void engTimer(tEngGame *pEngGame)
 {
     if (pEngGame->gameOver == 0)
     {
         if (pEngGame->suspended == 0)
         {
-            engLowerSolid(pEngGame);
+            engLower(pEngGame);
         }
 
-        interval = engGetTimestep(pEngGame);
+        pEngGame->lowerTime = pEngGame->time + engGetTimestep(pEngGame);
     }
     else
     {
-        interval = 0;
+        pEngGame->lowerTime = ENGNOTIME;
     }
-
-    return(interval);
 }
 
 /** Game over handling */
@@ -200,373 +494,713 @@ static void engGameOver(tEngGame *pEngGame)
         pEngGame->gameOver = 1;
         pEngGame->activeUser = 0;
 
-        if (pEngGame->onGameOver != NULL)
-        {
-            pEngGame->onGameOver(pEngGame);
-        }
+        engEndReplay(pEngGame);
+
+        engEvent(eEngEventGameOver, pEngGame->score, NULL, 0, pEngGame);
     }
 }
 
-/** Performing the queued transformation, return flag indicates if more
- *  call needed (1), or queue empty (0). */
-static int engAnimation(int interval, tEngGame *pEngGame)
+/** Publishes a change of the pose of the solid for the display */
+static void engMotion(const tEngObject *pFrom, int axis1, int axis2,
+                      int sign, tEngGame *pEngGame)
 {
-    if (pEngGame->animation.num > 0)
-    {
-        pEngGame->object.axices = m4dMultiplyMM(pEngGame->animation.transform,
-                                                pEngGame->object.axices);
-
-        pEngGame->object.pos = m4dAddVectors(pEngGame->object.pos,
-                                             pEngGame->animation.translation);
-
-        pEngGame->animation.num--;
-    }
+    pEngGame->motion.from  = *pFrom;
+    pEngGame->motion.time  = pEngGame->time;
+    pEngGame->motion.axis1 = axis1;
+    pEngGame->motion.axis2 = axis2;
+    pEngGame->motion.sign  = sign;
 
-    if (pEngGame->animation.num <= 0)
+    if (axis1 < 0)
     {
-        pEngGame->lock = 0;
-        return(0);
+        engEvent(eEngEventMove, 0, NULL, 0, pEngGame);
     }
     else
     {
-        return(interval);
+        int arg[3];
+
+        arg[0] = axis1;
+        arg[1] = axis2;
+        arg[2] = sign;
+        engEvent(eEngEventTurn, 0, arg, 3, pEngGame);
     }
 }
 
-/** Render/convert an object to gamespace array */
-static tEngSolid engObject2Solid(tEngObject object,
-                                 int *invalid,
-                                 tEngGame *pEngGame)
+/** Check if a cell is inside the game space */
+static int engCellInSpace(const int cell[ENGDIM], const tEngSpace *pSpace)
 {
-    int i, x, y, z, w;
-    tEngSolid solid;
-    tM4dVector vec;
+    int axis;
+    int inside = (cell[ENGAXISW] >= 0) && (cell[ENGAXISW] < pSpace->length);
 
-    if (invalid != NULL)
+    for (axis = 0; axis < ENGLEVELDIM; axis++)
     {
-        *invalid = 0;
+        inside &= (cell[axis] >= 0) && (cell[axis] < pSpace->size[axis]);
     }
 
-    solid = engEmptySolid;
+    return(inside);
+}
 
-    for (i = 0; i < object.block.num; i++)
-    {
-        vec = m4dMultiplyMV(object.axices, object.block.c[i]);
-        vec = m4dAddVectors(object.pos, vec);
+/** Collects the cells of an object in the gamespace
+ *  \return flag of any cell outside of the space */
+int engObject2Cells(const tEngObject *pObject,
+                    tEngCells *pCells,
+                    const tEngSpace *pSpace)
+{
+    int i, axis;
+    int invalid = 0;
+    const signed char (*offsets)[ENGDIM] =
+        engOrientCells[pObject->type][pObject->orient];
 
-        w = (int)floor(vec.c[eM4dAxisW]);
-        x = (int)floor(vec.c[eM4dAxisX]);
-        y = (int)floor(vec.c[eM4dAxisY]);
-        z = (int)floor(vec.c[eM4dAxisZ]);
+    pCells->num = engObjects[pObject->type].num;
 
-        if (    (x >= 0) && (x < pEngGame->size[0])
-                && (y >= 0) && (y < pEngGame->size[1])
-                && (z >= 0) && (z < pEngGame->size[2])
-                && (w >= 0) && (w < pEngGame->spaceLength)
-           )
+    for (i = 0; i < pCells->num; i++)
+    {
+        for (axis = 0; axis < ENGDIM; axis++)
         {
-            solid.c[w][x][y][z] = 1;
+            pCells->c[i][axis] = pObject->pos[axis] + offsets[i][axis];
         }
-        else
+
+        invalid |= !engCellInSpace(pCells->c[i], pSpace);
+    }
+
+    return(invalid);
+}
+
+/** Sets the sizes of the space and lays out its arrays in the arena,
+ *  (re)allocated if its size changes. The bitmasks of the levels come
+ *  first, the counters after them. */
+static void engAllocSpace(tEngSpace *pSpace, int length,
+                          const int size[ENGLEVELDIM])
+{
+    int axis;
+    size_t words, arenaSize;
+
+    pSpace->length     = length;
+    pSpace->levelCells = 1;
+
+    /*  dense row-major layout, the last level axis is contiguous */
+    for (axis = ENGLEVELDIM - 1; axis >= 0; axis--)
+    {
+        pSpace->size[axis]   = size[axis];
+        pSpace->stride[axis] = pSpace->levelCells;
+        pSpace->levelCells  *= size[axis];
+    }
+
+    pSpace->levelWords = (pSpace->levelCells + 63) / 64;
+
+    /*  levels and the full level, then heights and level fills */
+    words     = (size_t)(length + 1) * pSpace->levelWords;
+    arenaSize =   words * sizeof(uint64_t)
+                + ((size_t)pSpace->levelCells + length) * sizeof(int);
+
+    if ((pSpace->arena == NULL) || (pSpace->arenaSize != arenaSize))
+    {
+        free(pSpace->arena);
+        pSpace->arena     = malloc(arenaSize);
+        pSpace->arenaSize = arenaSize;
+
+        if (pSpace->arena == NULL)
         {
-            if (invalid != NULL)
-            {
-                *invalid = 1;
-            }
+            fprintf(stderr, "Out of memory for a game space of %d levels\n",
+                    length);
+            exit(1);
         }
     }
 
-    return solid;
+    pSpace->level     = pSpace->arena;
+    pSpace->full      = pSpace->level + (size_t)length * pSpace->levelWords;
+    pSpace->height    = (int *)(pSpace->level + words);
+    pSpace->levelFill = pSpace->height + pSpace->levelCells;
 }
 
-/** Check if a levels contains the same value at each cells */
-static int engEqLevel(tEngLevel level,
-                      int value,
-                      tEngGame *pEngGame)
+/** Empties the space with the given sizes */
+static void engResetSpace(tEngSpace *pSpace, int length,
+                          const int size[ENGLEVELDIM])
 {
-    int x, y, z;
-    int equal = 1;
+    int n;
 
-    for(x = 0; x < pEngGame->size[0]; x++)
-        for(y = 0; y < pEngGame->size[1]; y++)
-            for(z = 0; z < pEngGame->size[2]; z++)
-            {
-                if (level[x][y][z] != value)
-                {
-                    equal = 0;
-                }
-            }
+    engAllocSpace(pSpace, length, size);
+
+    memset(pSpace->arena, 0, pSpace->arenaSize);
 
-    return(equal);
+    for (n = 0; n < pSpace->levelCells; n++)
+    {
+        ENGSETCELL(pSpace->full, n);
+    }
+
+    pSpace->maxHeight = 0;
+    pSpace->filled    = 0;
 }
 
-/** Copy level to another. */
-static void engCopyLevel(tEngLevel target,
-                         tEngLevel source,
-                         tEngGame *pEngGame)
+/** Copies a space to another one, reusing the arena of the destination
+ *  if it has the same size (the arena of a new one has to be NULL) */
+void engCopySpace(tEngSpace *pDst, const tEngSpace *pSrc)
 {
-    int x, y, z;
+    engAllocSpace(pDst, pSrc->length, pSrc->size);
 
-    for(x = 0; x < pEngGame->size[0]; x++)
-        for(y = 0; y < pEngGame->size[1]; y++)
-            for(z = 0; z < pEngGame->size[2]; z++)
-            {
-                target[x][y][z] = source[x][y][z];
-            }
+    memcpy(pDst->arena, pSrc->arena, pSrc->arenaSize);
+
+    pDst->filled    = pSrc->filled;
+    pDst->maxHeight = pSrc->maxHeight;
 }
 
-/** Clears a levels */
-static void engClearLevel(tEngLevel level,
-                          tEngGame *pEngGame)
+/** Releases the arena of a space */
+void engFreeSpace(tEngSpace *pSpace)
 {
-    int x, y, z;
-
-    for(x = 0; x < pEngGame->size[0]; x++)
-        for(y = 0; y < pEngGame->size[1]; y++)
-            for(z = 0; z < pEngGame->size[2]; z++)
-            {
-                level[x][y][z] = 0;
-            }
+    free(pSpace->arena);
+    pSpace->arena     = NULL;
+    pSpace->arenaSize = 0;
 }
 
 /** Reset game variables */
 void engResetGame(tEngGame *pEngGame)
 {
-    int w;
+    int i;
+
+    /*  seed the random generator: the fixed seed if set,
+        else a fresh one from the previous random stream */
+    pEngGame->seed = (pEngGame->game_opts.seed != 0)
+                     ? pEngGame->game_opts.seed
+                     : rndNext(&pEngGame->rnd);
+    rndSeed(&pEngGame->rnd, pEngGame->seed);
 
-    /*  for the every part of the space */
-    for (w = 0; w < pEngGame->spaceLength; w++)
+    /*  empty the space, sizes might be changed since the last game */
+    for (i = 0; i < ENGLEVELDIM; i++)
     {
-        engClearLevel(pEngGame->space[w], pEngGame);
+        if (pEngGame->size[i] < 2)
+        {
+            pEngGame->size[i] = 2;
+        }
     }
+    if (pEngGame->spaceLength < 2)
+    {
+        pEngGame->spaceLength = 2;
+    }
+
+    engResetSpace(&pEngGame->space, pEngGame->spaceLength, pEngGame->size);
 
     /*  initialise the number of solids dropped */
     pEngGame->solidnum = 0;
 
+    /*  generate the coming solids */
+    for (i = 0; i < ENGPREVIEW; i++)
+    {
+        engGenerateSolid(&pEngGame->preview[i], pEngGame);
+    }
+    pEngGame->previewFirst = 0;
+
     /*  get new solid */
     engNewSolid(pEngGame);
 
     /*  init score value */
-    pEngGame->score = 0;
+    if (pEngGame->score != 0)
+    {
+        int gain = -pEngGame->score;
+
+        pEngGame->score = 0;
+        engEvent(eEngEventScore, 0, &gain, 1, pEngGame);
+    }
+    pEngGame->levels = 0;
     pEngGame->gameOver = 0;
 
-    pEngGame->animation.num = 0;
-    pEngGame->lock = 0;
     pEngGame->suspended        = 0;
 
-    pEngGame->animation.translation = m4dNullVector();
-    pEngGame->animation.transform   = m4dUnitMatrix();
+    /*  stop the timed actions, restart lowering */
+    pEngGame->motion.time    = ENGNOTIME;
+    pEngGame->drop.time      = ENGNOTIME;
+    pEngGame->lowerTime      = pEngGame->time + engGetTimestep(pEngGame);
 
-    clearTimerCallback(pEngGame->fnID_lower);
-    clearTimerCallback(pEngGame->fnID_dropdown);
+    /*  start recording the game */
+    if (pEngGame->game_opts.record)
+    {
+        tRplHeader header;
 
-    pEngGame->fnID_lower = setTimerCallback(engGetTimestep(pEngGame),
-                                            (tTimerCallback)engTimer,
-                                            pEngGame);
+        header.dim    = ENGDIM;
+        header.seed   = pEngGame->seed;
+        header.diff   = pEngGame->game_opts.diff;
+        header.length = pEngGame->space.length;
+        for (i = 0; i < ENGLEVELDIM; i++)
+        {
+            header.size[i] = pEngGame->space.size[i];
+        }
+
+        rplBegin(&pEngGame->replay, &header, pEngGame->time);
+    }
 }
 
 
 /** initialize the game variables */
-void engInitGame(tEngGame *pEngGame, tEngGameEvent onGameOver)
+void engInitGame(tEngGame *pEngGame)
 {
+    int i;
+
     /*  initialize random generator */
-    srand(time(NULL));
+    rndSeed(&pEngGame->rnd, time(NULL));
+
+    /*  build the object tables */
+    engInitTables();
 
     /*  set options */
     pEngGame->game_opts.diff   = 2;
-    pEngGame->animation.enable = 1;
+    pEngGame->game_opts.seed   = 0;
+    pEngGame->game_opts.record = 1;
     pEngGame->activeUser       = 0;
     pEngGame->spaceLength      = 12;
-    pEngGame->size[0]          = 2;
-    pEngGame->size[1]          = 2;
-    pEngGame->size[2]          = 2;
-    pEngGame->fnID_dropdown    = NULL;
-    pEngGame->fnID_lower       = NULL;
+    for (i = 0; i < ENGLEVELDIM; i++)
+    {
+        pEngGame->size[i]      = 2;
+    }
+    pEngGame->time             = 0;
     pEngGame->suspended        = 0;
-    pEngGame->lock = 0;
+    pEngGame->score            = 0;
+
+    /*  no events queued */
+    atomic_init(&pEngGame->events.head, 0);
+    atomic_init(&pEngGame->events.tail, 0);
+    pEngGame->events.lost      = 0;
+
+    engResetStats(pEngGame);
 
-    pEngGame->onGameOver       = onGameOver;
+    /*  the space is allocated at the reset */
+    pEngGame->space.arena      = NULL;
+    pEngGame->space.arenaSize  = 0;
+    pEngGame->drop.space.arena     = NULL;
+    pEngGame->drop.space.arenaSize = 0;
+    rplInit(&pEngGame->replay);
+
+    /*  no autoplayer until it plays */
+    pEngGame->pAiGamer         = NULL;
 
     /*  reset parameters */
     engResetGame(pEngGame);
 }
 
+/** release the memory of the game */
+void engFreeGame(tEngGame *pEngGame)
+{
+    engFreeSpace(&pEngGame->space);
+    engFreeSpace(&pEngGame->drop.space);
+    rplFree(&pEngGame->replay);
+}
+
 /** get random object index based on difficulty level */
 static int engRandSolidnum(tEngGame *pEngGame)
 {
-    /*  probability */
-    int prob, prb;
-    /*  sum of probabilities */
-    int sum = 0;
-    /*  loop counter / index of random object */
-    int i;
+    return(rndAlias(&pEngGame->rnd, &engProbAlias[pEngGame->game_opts.diff]));
+}
+
 
-    /*  for every solid type */
-    for (i = 0; i < OBJECTTYPES; i++)
+/** get random orientation for a new solid:
+ *  the level axices permuted and mirrored, w kept */
+static int engRandOrient(tEngGame *pEngGame)
+{
+    int axis[ENGDIM];
+    int sign[ENGDIM];
+    int rest[ENGLEVELDIM]; /* axices not yet used, in increasing order */
+    int i, j, num;
+    int fact = 1;
+
+    for (i = 0; i < ENGLEVELDIM; i++)
     {
-        /*  summarize the probability */
-        sum += engProbs[pEngGame->game_opts.diff][i];
+        rest[i] = i;
+        fact *= i + 1;
     }
 
-    /*  initialize loop counter */
-    i = 0;
+    /*  index of the permutation in lexicographic order */
+    num = rndRange(&pEngGame->rnd, fact);
 
-    /*  get a random probability */
-    prob = (long int) (sum * (rand() / (RAND_MAX + 1.0) ));
+    for (i = 0; i < ENGLEVELDIM; i++)
+    {
+        /*  digits of the index in factorial base select from the rest */
+        fact /= ENGLEVELDIM - i;
+        j = num / fact;
+        num %= fact;
 
-    prb = engProbs[pEngGame->game_opts.diff][i];
+        axis[i] = rest[j];
+        for (; j < ENGLEVELDIM - i - 1; j++)
+        {
+            rest[j] = rest[j+1];
+        }
 
-    while (!(prob < prb))
-    {
-        i++;
-        prb += engProbs[pEngGame->game_opts.diff][i];
+        sign[i] = (rndRange(&pEngGame->rnd, 2) == 0) ? 1 : -1;
     }
 
-    return(i);
-}
+    axis[ENGAXISW] = ENGAXISW;
+    sign[ENGAXISW] = 1;
 
+    return(ortIndex(axis, sign));
+}
 
-/** get a new random solid */
-static void engNewSolid(tEngGame *pEngGame)
+/** generate a random solid in its initial pose */
+static void engGenerateSolid(tEngObject *pObject, tEngGame *pEngGame)
 {
-    int index = engRandSolidnum(pEngGame);
+    int axis;
 
-    pEngGame->object.axices = m4dRandUnitMatrix();
+    pObject->type = engRandSolidnum(pEngGame);
 
-    pEngGame->object.block = engObjects[index];
+    pObject->orient = engRandOrient(pEngGame);
 
     /*  position the new solid to the */
     /*  top 2 level of the space */
-    pEngGame->object.pos = m4dVector(1.0 + rand() % (pEngGame->size[0]-1),
-                                     1.0 + rand() % (pEngGame->size[1]-1),
-                                     1.0 + rand() % (pEngGame->size[2]-1),
-                                     pEngGame->spaceLength - 1.0);
+    for (axis = 0; axis < ENGLEVELDIM; axis++)
+    {
+        pObject->pos[axis] =
+            1 + rndRange(&pEngGame->rnd, pEngGame->space.size[axis]-1);
+    }
+    pObject->pos[ENGAXISW] = pEngGame->space.length - 1;
+}
+
+/** get the next solid from the preview, generate one in its place */
+static void engNewSolid(tEngGame *pEngGame)
+{
+    tEngObject *pNext = &pEngGame->preview[pEngGame->previewFirst];
+
+    pEngGame->object = *pNext;
+    pEngGame->motion.time = ENGNOTIME;
+
+    engGenerateSolid(pNext, pEngGame);
+    pEngGame->previewFirst = (pEngGame->previewFirst + 1) % ENGPREVIEW;
 
     /*  increase the number of the solid */
     pEngGame->solidnum++;
+    pEngGame->stats.count[eEngCountSolid]++;
+
+    engEvent(eEngEventSpawn, pEngGame->solidnum, NULL, 0, pEngGame);
 }
 
-/** check overlap between solid and gamespace
+/** get a coming solid in its initial pose
+ *  \return the n-th solid after the actual one (from 0),
+ *          NULL if not generated yet */
+const tEngObject *engPeekSolid(int n, const tEngGame *pEngGame)
+{
+    if ((n < 0) || (n >= ENGPREVIEW))
+    {
+        return(NULL);
+    }
+
+    return(&pEngGame->preview[(pEngGame->previewFirst + n) % ENGPREVIEW]);
+}
+
+/** check overlap between an object and the space
  *  \return overlapping detected flag */
-static int engOverlapping(tEngGame *pEngGame)
+int engOverlapping(const tEngObject *pObject, const tEngSpace *pSpace)
 {
-    int w, x, y, z;
-    int overlap = 0;
+    int i;
+    tEngCells cells;
 
-    tEngSolid solid = engObject2Solid(pEngGame->object, &overlap, pEngGame);
+    /*  out of the space */
+    if (engObject2Cells(pObject, &cells, pSpace))
+    {
+        return(1);
+    }
 
-    for(w = 0; w < pEngGame->spaceLength; w++)
-        for(x = 0; x < pEngGame->size[0]; x++)
-            for(y = 0; y < pEngGame->size[1]; y++)
-                for(z = 0; z < pEngGame->size[2]; z++)
-                {
-                    if (solid.c[w][x][y][z])
-                    {
-                        overlap |=  pEngGame->space[w][x][y][z];
-                    };
-                }
+    for (i = 0; i < cells.num; i++)
+    {
+        if (ENGSPACECELL(pSpace, cells.c[i]))
+        {
+            return(1);
+        }
+    }
 
-    return(overlap);
+    return(0);
 
 }/* end of checkOverlap */
 
-/** deletes the full levels */
-static void engKillFullLevels(tEngGame *pEngGame)
+/** check overlap between the solid of the game and its space (counted)
+ *  \return overlapping detected flag */
+static int engSolidOverlapping(tEngGame *pEngGame)
+{
+    pEngGame->stats.count[eEngCountOverlap]++;
+
+    return(engOverlapping(&pEngGame->object, &pEngGame->space));
+}
+
+/** deletes the full levels, recording them to the placement */
+void engKillFullLevels(tEngPlacement *pPlacement, tEngSpace *pSpace)
 {
     /*  loop counter */
-    int t, tn;
-    int clearedLevels = 0;
+    int t;
+    size_t words = pSpace->levelWords;
+
+    pPlacement->clearedNum = 0;
 
     /*  for every level */
-    for(t = 0; t < pEngGame->spaceLength; t++)
+    for(t = 0; t < pSpace->length; t++)
     {
         /*  if full level found */
-        if (engEqLevel(pEngGame->space[t], 1, pEngGame))
+        if (pSpace->levelFill[t] == pSpace->levelCells)
         {
             /*  step down every higher level */
-            for (tn = t+1; tn < pEngGame->spaceLength; tn++)
-            {
-                /*  get the next level */
-                engCopyLevel(pEngGame->space[tn-1], pEngGame->space[tn], pEngGame);
-            } /*  end of every level */
+            memmove(ENGLEVEL(pSpace, t), ENGLEVEL(pSpace, t+1),
+                    (pSpace->length-t-1) * words * sizeof(uint64_t));
+            memmove(&pSpace->levelFill[t], &pSpace->levelFill[t+1],
+                    (pSpace->length-t-1) * sizeof(int));
             /*  0 on the top level */
-            engClearLevel(pEngGame->space[pEngGame->spaceLength-1], pEngGame);
-            clearedLevels++;
+            memset(ENGLEVEL(pSpace, pSpace->length-1), 0,
+                   words * sizeof(uint64_t));
+            pSpace->levelFill[pSpace->length-1] = 0;
+            pSpace->filled -= pSpace->levelCells;
+            pPlacement->cleared[pPlacement->clearedNum++] = t;
 
             /*  step back with the loop counter to get the same level checked again */
             t--;
         }
     } /*  end of every level */
 
-    engUpdateScore(clearedLevels, pEngGame);
+    if (pPlacement->clearedNum > 0)
+    {
+        engUpdateHeights(pSpace);
+    }
 } /* end of checkFullLevels */
 
-/** lower the solid with one level
-   \return false if invalid (end of game) */
-int engLowerSolid(tEngGame *pEngGame)
+/** Lowers the column heights to the filled cells after levels removed */
+static void engUpdateHeights(tEngSpace *pSpace)
 {
-    int w, x, y, z;
-    int onFloor = 0;
+    int n, h;
 
-    if (!pEngGame->lock)
+    pSpace->maxHeight = 0;
+
+    for (n = 0; n < pSpace->levelCells; n++)
     {
-        pEngGame->object.pos.c[eM4dAxisW]--;
+        /*  columns only can get lower */
+        h = pSpace->height[n];
+
+        while ((h > 0) && !ENGGETCELL(ENGLEVEL(pSpace, h-1), n))
+        {
+            h--;
+        }
+
+        pSpace->height[n] = h;
+
+        if (h > pSpace->maxHeight)
+        {
+            pSpace->maxHeight = h;
+        }
+    }
+}
 
-        onFloor = engOverlapping(pEngGame);
+/** Number of levels an object can be lowered by until it lands */
+int engDropDistance(const tEngObject *pObject, const tEngSpace *pSpace)
+{
+    int i, w, d, n;
+    int distance = pSpace->length;
+    tEngCells cells;
+
+    engObject2Cells(pObject, &cells, pSpace);
+
+    for (i = 0; i < cells.num; i++)
+    {
+        n = engLevelIndex(cells.c[i], pSpace);
+        w = cells.c[i][ENGAXISW];
 
-        if (onFloor)
+        if (w >= pSpace->height[n])
         {
-            pEngGame->object.pos.c[eM4dAxisW]++;
+            /*  above the column */
+            d = w - pSpace->height[n];
         }
         else
         {
-            if (pEngGame->animation.enable)
+            /*  below the top of the column (under an overhang) */
+            d = 0;
+            while ((w-d > 0) && !ENGGETCELL(ENGLEVEL(pSpace, w-d-1), n))
             {
-                pEngGame->object.pos.c[eM4dAxisW]++;
+                d++;
+            }
+        }
 
-                pEngGame->lock = 1;
-                pEngGame->animation.num = 2;
-                pEngGame->animation.translation = m4dVector(0.0,0.0,0.0,
-                                                  -1.0 / pEngGame->animation.num);
-                pEngGame->animation.transform   = m4dUnitMatrix();
+        if (d < distance)
+        {
+            distance = d;
+        }
+    }
 
-                setTimerCallback(engAnimationTimeStep,
-                                 (tTimerCallback)engAnimation,
-                                 pEngGame);
-            }
+    return(distance);
+}
+
+/** Puts the cells to the space, recording the changes to the placement */
+void engFillCells(const tEngCells *pCells,
+                  tEngPlacement *pPlacement,
+                  tEngSpace *pSpace)
+{
+    int i, w, n;
+
+    pPlacement->cells     = *pCells;
+    pPlacement->maxHeight = pSpace->maxHeight;
+
+    for (i = 0; i < pCells->num; i++)
+    {
+        w = pCells->c[i][ENGAXISW];
+        n = engLevelIndex(pCells->c[i], pSpace);
+
+        ENGSETCELL(ENGLEVEL(pSpace, w), n);
+        pSpace->levelFill[w]++;
+
+        /*  raise the column */
+        pPlacement->height[i] = pSpace->height[n];
+        if (w >= pSpace->height[n])
+        {
+            pSpace->height[n] = w + 1;
         }
+        if (w >= pSpace->maxHeight)
+        {
+            pSpace->maxHeight = w + 1;
+        }
+    }
+    pSpace->filled += pCells->num;
+}
+
+/** Puts the cells to the space and deletes the levels got full,
+ *  recording the changes to the placement.
+ *  \return number of levels cleared */
+int engPlaceCells(const tEngCells *pCells,
+                  tEngPlacement *pPlacement,
+                  tEngSpace *pSpace)
+{
+    engFillCells(pCells, pPlacement, pSpace);
+
+    /*  delete the full levels */
+    engKillFullLevels(pPlacement, pSpace);
 
-        /*  if reached the floor, */
-        if (onFloor)
+    return(pPlacement->clearedNum);
+}
+
+/** Restores the space before the placement */
+void engUndoPlacement(const tEngPlacement *pPlacement, tEngSpace *pSpace)
+{
+    int i, k, t, w, n;
+    size_t words = pSpace->levelWords;
+    const tEngCells *pCells = &pPlacement->cells;
+
+    /*  insert back the cleared levels in reverse order */
+    for (k = pPlacement->clearedNum - 1; k >= 0; k--)
+    {
+        t = pPlacement->cleared[k];
+
+        memmove(ENGLEVEL(pSpace, t+1), ENGLEVEL(pSpace, t),
+                (pSpace->length-t-1) * words * sizeof(uint64_t));
+        memmove(&pSpace->levelFill[t+1], &pSpace->levelFill[t],
+                (pSpace->length-t-1) * sizeof(int));
+        memcpy(ENGLEVEL(pSpace, t), pSpace->full, words * sizeof(uint64_t));
+        pSpace->levelFill[t] = pSpace->levelCells;
+        pSpace->filled += pSpace->levelCells;
+    }
+
+    /*  remove the cells */
+    for (i = 0; i < pCells->num; i++)
+    {
+        w = pCells->c[i][ENGAXISW];
+
+        ENGCLEARCELL(ENGLEVEL(pSpace, w), engLevelIndex(pCells->c[i], pSpace));
+        pSpace->levelFill[w]--;
+    }
+    pSpace->filled -= pCells->num;
+
+    if (pPlacement->clearedNum > 0)
+    {
+        /*  every column changed, search them down from the top */
+        for (n = 0; n < pSpace->levelCells; n++)
         {
-            tEngSolid solid = engObject2Solid(pEngGame->object, NULL, pEngGame);
-
-            /*  put the solid to the space */
-            for(w = 0; w < pEngGame->spaceLength; w++)
-                for(x = 0; x < pEngGame->size[0]; x++)
-                    for(y = 0; y < pEngGame->size[1]; y++)
-                        for(z = 0; z < pEngGame->size[2]; z++)
-                        {
-                            pEngGame->space[w][x][y][z] |= solid.c[w][x][y][z];
-                        }
-
-            /*  delete the full levels */
-            engKillFullLevels(pEngGame);
-            /*  get new solid */
-            engNewSolid(pEngGame);
-
-            /*  check new solid already overlapped */
-            if (engOverlapping(pEngGame))
-            {
-                engGameOver(pEngGame);
-            }
+            pSpace->height[n] = pPlacement->maxHeight;
         }
+
+        engUpdateHeights(pSpace);
+    }
+    else
+    {
+        /*  restore the raised columns in reverse order */
+        for (i = pCells->num - 1; i >= 0; i--)
+        {
+            pSpace->height[engLevelIndex(pCells->c[i], pSpace)] =
+                pPlacement->height[i];
+        }
+    }
+
+    pSpace->maxHeight = pPlacement->maxHeight;
+}
+
+/** puts the landed solid to the space, deletes the full levels
+ *  and gets the next solid */
+static void engLandSolid(tEngGame *pEngGame)
+{
+    tEngCells cells;
+    tEngPlacement placement;
+    int clearedLevels;
+    uint64_t start;
+
+    engObject2Cells(&pEngGame->object, &cells, &pEngGame->space);
+
+    /*  put the solid to the space, delete the full levels */
+    engFillCells(&cells, &placement, &pEngGame->space);
+
+    start = prfNow();
+    engKillFullLevels(&placement, &pEngGame->space);
+    prfHistAdd(&pEngGame->stats.time[eEngTimeKill], prfNow() - start);
+
+    clearedLevels = placement.clearedNum;
+    pEngGame->levels += clearedLevels;
+
+    pEngGame->stats.count[eEngCountLock]++;
+    pEngGame->stats.count[eEngCountLevels] += clearedLevels;
+
+    engEvent(eEngEventLock, 0, NULL, 0, pEngGame);
+    if (clearedLevels > 0)
+    {
+        engEvent(eEngEventClear, clearedLevels,
+                 placement.cleared, clearedLevels, pEngGame);
+    }
+
+    engUpdateScore(clearedLevels, pEngGame);
+
+    /*  get new solid */
+    engNewSolid(pEngGame);
+
+    /*  check new solid already overlapped */
+    if (engSolidOverlapping(pEngGame))
+    {
+        engGameOver(pEngGame);
+    }
+}
+
+/** lower the solid with one level (input of the game)
+   \return false if invalid (end of game) */
+int engLowerSolid(tEngGame *pEngGame)
+{
+    engRecord(eRplOpLower, 0, 0, 0, pEngGame);
+
+    return(engLower(pEngGame));
+}
+
+/** lower the solid with one level
+   \return false if invalid (end of game) */
+static int engLower(tEngGame *pEngGame)
+{
+    int onFloor;
+    tEngObject obj = pEngGame->object;
+    uint64_t start = prfNow();
+
+    /*  the solid of the game over overlaps the space, not to be landed */
+    if (pEngGame->gameOver)
+    {
+        return(0);
+    }
+
+    pEngGame->object.pos[ENGAXISW]--;
+
+    onFloor = engSolidOverlapping(pEngGame);
+
+    /*  if reached the floor, */
+    if (onFloor)
+    {
+        pEngGame->object = obj;
+
+        engLandSolid(pEngGame);
     }
     else
     {
-        /** \todo should be lowered also in case of locked*/
+        engMotion(&obj, -1, -1, 0, pEngGame);
     }
 
+    prfHistAdd(&pEngGame->stats.time[eEngTimeLower], prfNow() - start);
+
     return( (onFloor || pEngGame->gameOver) ? 0 : 1);
 }
 
@@ -577,45 +1211,38 @@ int engTurn(char ax1, char ax2, char sign1, char sign2, tEngGame *pEngGame)
 {
     tEngObject obj;
     int result;
-    double angle;
+    uint64_t start = prfNow();
+
+    engRecord(eRplOpTurn, ax1, ax2, sign1 * sign2, pEngGame);
+
+    if (pEngGame->gameOver)
+    {
+        return(0);
+    }
 
     /*  store object */
     obj = pEngGame->object;
 
     /*  turn it */
-    angle = sign1 * sign2 * M_PI / 2.0;
-    pEngGame->object.axices = m4dMultiplyMM(m4dRotMatrix(ax1, ax2, angle),
-                                            pEngGame->object.axices);
+    pEngGame->object.orient = ortTurn(obj.orient, ax1, ax2, sign1 * sign2);
 
     /*  if overlapped, invalid turn */
     /*  get back the original */
-    if (engOverlapping(pEngGame))
+    if (engSolidOverlapping(pEngGame))
     {
         pEngGame->object = obj;
         result = 0;
+        pEngGame->stats.count[eEngCountTurnRejected]++;
     }
     else
     {
+        engMotion(&obj, ax1, ax2, sign1 * sign2, pEngGame);
         result = 1;
-
-        if (pEngGame->animation.enable)
-        {
-            pEngGame->object = obj;
-            if (!pEngGame->lock)
-            {
-                pEngGame->lock = 1;
-                pEngGame->animation.num  = 5;
-                pEngGame->animation.translation = m4dNullVector();
-                pEngGame->animation.transform   = m4dRotMatrix(ax1, ax2, angle
-                                                  / pEngGame->animation.num);
-
-                setTimerCallback(engAnimationTimeStep,
-                                 (tTimerCallback)engAnimation,
-                                 pEngGame);
-            }
-        }
+        pEngGame->stats.count[eEngCountTurn]++;
     }
 
+    prfHistAdd(&pEngGame->stats.time[eEngTimeTurn], prfNow() - start);
+
     return(result);
 }
 
@@ -623,67 +1250,249 @@ int engTurn(char ax1, char ax2, char sign1, char sign2, tEngGame *pEngGame)
 int engMove(char axle, int direction, tEngGame *pEngGame)
 {
     tEngObject objStored  = pEngGame->object;
-    tM4dVector moveVector = m4dMultiplySV(direction, m4dUnitVector(axle));
     int valid;
+    uint64_t start = prfNow();
+
+    engRecord(eRplOpMove, axle, direction, 0, pEngGame);
+
+    if (pEngGame->gameOver)
+    {
+        return(0);
+    }
 
-    pEngGame->object.pos = m4dAddVectors(pEngGame->object.pos, moveVector);
+    pEngGame->object.pos[(int)axle] += direction;
 
-    valid = !engOverlapping(pEngGame);
+    valid = !engSolidOverlapping(pEngGame);
 
     if (valid)
     {
-        if (pEngGame->animation.enable)
-        {
-            pEngGame->object = objStored;
-
-            if (!pEngGame->lock)
-            {
-                pEngGame->lock = 1;
-                pEngGame->animation.num  = 3;
-                pEngGame->animation.translation = m4dMultiplySV(1.0 / pEngGame->animation.num,
-                                                  moveVector);
-                pEngGame->animation.transform   = m4dUnitMatrix();
-
-                setTimerCallback(engAnimationTimeStep,
-                                 (tTimerCallback)engAnimation,
-                                 pEngGame);
-            }
-        }
+        engMotion(&objStored, -1, -1, 0, pEngGame);
+        pEngGame->stats.count[eEngCountMove]++;
     }
     else
     {
         pEngGame->object = objStored;
+        pEngGame->stats.count[eEngCountMoveRejected]++;
     }
 
+    prfHistAdd(&pEngGame->stats.time[eEngTimeMove], prfNow() - start);
+
     return(valid);
 }
 
 
-/** Prints out the game space to std out. */
+/** Prints out the game space to std out,
+ *  the cells of a level in a line from the top level. */
 void engPrintSpace(tEngGame *pEngGame)
 {
-    int w, x, y, z;
+    int w, n, i, solid;
+    tEngCells cells;
+    const tEngSpace *pSpace = &pEngGame->space;
 
-    tEngSolid solid = engObject2Solid(pEngGame->object, NULL, pEngGame);
+    engObject2Cells(&pEngGame->object, &cells, pSpace);
 
-    for(y = pEngGame->size[1]-1; y >= 0; y--)
+    for(w = pSpace->length - 1; w >= 0; w--)
     {
-        for(z = pEngGame->size[2]-1; z >= 0 ; z--)
+        for (n = 0; n < pSpace->levelCells; n++)
         {
-            printf((z == 1) ? " " : "");
-            for(w = 0; w < pEngGame->spaceLength; w++)
+            /*  cell of the solid */
+            solid = 0;
+            for (i = 0; i < cells.num; i++)
             {
-                for(x = 0; x < pEngGame->size[0]; x++)
-                {
-                    printf(pEngGame->space[w][x][y][z] ? "X" :
-                           solid.c[w][x][y][z]         ? "#" :
-                           ".");
-                    printf("  ");
-                }
-                printf(" ");
+                solid |= (   (engLevelIndex(cells.c[i], pSpace) == n)
+                          && (cells.c[i][ENGAXISW] == w));
             }
-            printf("\n");
+
+            printf(ENGGETCELL(ENGLEVEL(pSpace, w), n) ? "X" :
+                   solid                              ? "#" :
+                   ".");
         }
+        printf("\n");
     }
     printf("\n");
 }
+
+/** Flags of the game recorded to the replays */
+static int engFlags(const tEngGame *pEngGame)
+{
+    return(  (pEngGame->activeUser ? ENGFLAGUSER      : 0)
+           | (pEngGame->suspended  ? ENGFLAGSUSPENDED : 0));
+}
+
+/** Records an input of the game to its replay, preceded by the flags
+ *  if changed since they were recorded */
+static void engRecord(tRplOpType type, int arg0, int arg1, int arg2,
+                      tEngGame *pEngGame)
+{
+    tRplOp op;
+    tRplReplay *pReplay = &pEngGame->replay;
+
+    if (!pEngGame->game_opts.record || pReplay->ended)
+    {
+        return;
+    }
+
+    op.time   = pEngGame->time;
+    op.hash   = 0;
+    op.arg[1] = 0;
+    op.arg[2] = 0;
+
+    if (engFlags(pEngGame) != pReplay->flags)
+    {
+        op.type   = eRplOpFlags;
+        op.arg[0] = engFlags(pEngGame);
+        rplPut(pReplay, &op);
+
+        pReplay->flags = op.arg[0];
+    }
+
+    if (type != eRplOpFlags)
+    {
+        op.type   = type;
+        op.arg[0] = arg0;
+        op.arg[1] = arg1;
+        op.arg[2] = arg2;
+        rplPut(pReplay, &op);
+    }
+}
+
+/** Adds bytes to a state hash (FNV-1a) */
+static uint64_t engHashBytes(uint64_t hash, const void *pData, size_t size)
+{
+    const unsigned char *pByte = pData;
+    size_t i;
+
+    for (i = 0; i < size; i++)
+    {
+        hash = (hash ^ pByte[i]) * 0x100000001b3ULL;
+    }
+
+    return(hash);
+}
+
+/** Hash of a space and a solid in it: the filled cells and the solid */
+uint64_t engHashSpace(const tEngObject *pObject, const tEngSpace *pSpace)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    hash = engHashBytes(hash, pSpace->level,
+                        (size_t)pSpace->length * pSpace->levelWords
+                        * sizeof(uint64_t));
+    hash = engHashBytes(hash, pObject, sizeof(tEngObject));
+
+    return(hash);
+}
+
+/** Hash of the state of the game: the space, the solid and the results */
+uint64_t engHashState(const tEngGame *pEngGame)
+{
+    uint64_t hash;
+    int results[4];
+
+    results[0] = pEngGame->score;
+    results[1] = pEngGame->levels;
+    results[2] = pEngGame->solidnum;
+    results[3] = pEngGame->gameOver;
+
+    hash = engHashSpace(&pEngGame->object, &pEngGame->space);
+    hash = engHashBytes(hash, results, sizeof(results));
+
+    return(hash);
+}
+
+/** Closes the replay of the game with the hash of its actual state
+ *  (done at game over)
+ *  \return the replay */
+const tRplReplay *engEndReplay(tEngGame *pEngGame)
+{
+    tRplOp op;
+
+    if (pEngGame->game_opts.record && !pEngGame->replay.ended)
+    {
+        op.type = eRplOpEnd;
+        op.time = pEngGame->time;
+        op.hash = engHashState(pEngGame);
+
+        rplPut(&pEngGame->replay, &op);
+    }
+
+    return(&pEngGame->replay);
+}
+
+/** Plays a replay again in an initialised game as fast as possible
+ *  \return 1 if the final state matches the recorded one, 0 if not,
+ *          -1 if the replay is invalid or of an other dimension */
+int engPlayReplay(const tRplReplay *pReplay, tEngGame *pEngGame)
+{
+    tRplReader reader;
+    tRplHeader header;
+    tRplOp op;
+    long start, dt;
+    int i, result;
+
+    if (   (rplOpen(&reader, &header, pReplay) != 0)
+        || (header.dim != ENGDIM)
+        || (header.diff < 0) || (header.diff >= DIFFLEVELS))
+    {
+        return(-1);
+    }
+
+    pEngGame->game_opts.seed   = header.seed;
+    pEngGame->game_opts.diff   = header.diff;
+    pEngGame->game_opts.record = 0;
+    pEngGame->spaceLength      = header.length;
+    for (i = 0; i < ENGLEVELDIM; i++)
+    {
+        pEngGame->size[i] = header.size[i];
+    }
+
+    engResetGame(pEngGame);
+    start = pEngGame->time;
+
+    while ((result = rplRead(&reader, &op)) > 0)
+    {
+        /*  the time to the input, stepped by an int */
+        dt = start + op.time - pEngGame->time;
+        if ((dt < 0) || (dt > INT_MAX))
+        {
+            return(-1);
+        }
+
+        engStep(pEngGame, dt);
+
+        /*  inputs out of the range of the engine */
+        if (   (   (op.type == eRplOpTurn)
+                && (   (op.arg[0] < 0) || (op.arg[0] >= ENGDIM)
+                    || (op.arg[1] < 0) || (op.arg[1] >= ENGDIM)))
+            || (   (op.type == eRplOpMove)
+                && ((op.arg[0] < 0) || (op.arg[0] >= ENGLEVELDIM))))
+        {
+            return(-1);
+        }
+
+        switch (op.type)
+        {
+        case eRplOpTurn:
+            engTurn(op.arg[0], op.arg[1], op.arg[2], 1, pEngGame);
+            break;
+        case eRplOpMove:
+            engMove(op.arg[0], op.arg[1], pEngGame);
+            break;
+        case eRplOpLower:
+            engLowerSolid(pEngGame);
+            break;
+        case eRplOpDrop:
+            engDropSolid(pEngGame);
+            break;
+        case eRplOpFlags:
+            pEngGame->activeUser = (op.arg[0] & ENGFLAGUSER) != 0;
+            pEngGame->suspended  = (op.arg[0] & ENGFLAGSUSPENDED) != 0;
+            break;
+        default:
+            return((engHashState(pEngGame) == op.hash) ? 1 : 0);
+        }
+    }
+
+    /*  no end record */
+    return(-1);
+}
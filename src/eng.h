@@ -11,16 +11,28 @@
    INCLUDES
 ------------------------------------------------------------------------------*/
 
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
 #include "m4d.h"
+#include "rnd.h"
+#include "ort.h"
+#include "rpl.h"
+#include "prf.h"
 
 /*------------------------------------------------------------------------------
    MACROS
 ------------------------------------------------------------------------------*/
 
-/** length of the game space (num of levels) */
-#define SPACELENGTH 20
-/** Size of gamespace */
-#define SPACESIZE 4
+/*  ENGDIM: dimension of the game space, set at compile time to 3, 4 or 5
+    (default 4, see ort.h). The levels are of ENGDIM-1 dimensions, the
+    solids fall along the last axis. Only the 4D game is displayed. */
+
+/** Number of the axices of a level */
+#define ENGLEVELDIM (ENGDIM - 1)
+/** Axis the solids fall along */
+#define ENGAXISW (ENGDIM - 1)
 
 /** number of difficulty levels */
 #define DIFFLEVELS 3
@@ -28,18 +40,36 @@
 /** Number of blocks in an object */
 #define MAXBLOCKNUM 4
 
+/** Number of the types of the solids */
+#if ENGDIM == 3
+#define ENGOBJECTTYPES 4
+#else
+#define ENGOBJECTTYPES 6
+#endif
+
+/** Number of the coming solids generated ahead */
+#define ENGPREVIEW 4
+
+/** Number of the events queued (power of 2) */
+#define ENGEVENTS 256
+
+/** Time of timed actions not scheduled */
+#define ENGNOTIME (-1)
+
+/** Flags of the game recorded to the replays */
+#define ENGFLAGUSER      1  /**< real user gaming */
+#define ENGFLAGSUSPENDED 2  /**< engine suspended */
+
 /*------------------------------------------------------------------------------
    TYPE DEFINITIONS
 ------------------------------------------------------------------------------*/
 
-/** one 3D level of the game space x, y, z */
-typedef char tEngLevel[SPACESIZE][SPACESIZE][SPACESIZE];
-
-/** 2x2x2x2 supercube / container of a Solid */
+/** Cells of the blocks of an object in the game space */
 typedef struct
 {
-    tEngLevel c[SPACELENGTH];
-} tEngSolid;
+    int num;                        /**< Number of cells */
+    int c[MAXBLOCKNUM][ENGDIM];     /**< Coordinates (x, y, z, w) of cells */
+} tEngCells;
 
 /** Container of block array */
 typedef struct
@@ -51,67 +81,213 @@ typedef struct
 /** Object container struct */
 typedef struct
 {
-    tM4dVector pos;    /**< actual position of the object */
-    tM4dMatrix axices; /**< Vectors of the 4 axices
-                          builds the object's own coord.sys */
-    tEngBlocks block;  /**< Vectors of each blocks center  in the
-                          objects's own coordinate system */
+    int pos[ENGDIM];     /**< actual position of the object (cell coords) */
+    int orient;          /**< index of the object's orientation (see ort.h) */
+    int type;            /**< index of the object type */
 } tEngObject;
 
+/** Game space: the filled cells and the summaries kept of them.
+    Compact state of the search, separated from the game's UI and
+    timing variables. Its arrays are in one arena allocated at reset
+    for the actual sizes. */
+typedef struct
+{
+    /** number of levels */
+    int length;
+    /** level sizes (x, y, z) */
+    int size[ENGLEVELDIM];
+    /** index step of the cells of a level along the level axices */
+    int stride[ENGLEVELDIM];
+    /** number of cells in a level */
+    int levelCells;
+    /** number of 64 bit words storing the cells of a level */
+    int levelWords;
+    /** levels of the space packed to bitmasks of levelWords words each,
+        the bit of a cell is the sum of its coordinates by the strides */
+    uint64_t *level;
+    /** a level with all of its cells filled */
+    uint64_t *full;
+    /** number of filled cells in each level */
+    int *levelFill;
+    /** number of filled cells in the space */
+    int filled;
+    /** height of the columns by their cell index in the level: the level
+        above their highest filled cell, 0 if empty */
+    int *height;
+    /** height of the highest column */
+    int maxHeight;
+    /** memory of the arrays above */
+    void *arena;
+    /** size of the arena [bytes] */
+    size_t arenaSize;
+} tEngSpace;
+
+/** Changes made by placing an object into the space, to be undone */
+typedef struct
+{
+    tEngCells cells;            /**< cells filled */
+    int height[MAXBLOCKNUM];    /**< previous heights of their columns */
+    int maxHeight;              /**< previous height of the highest column */
+    int clearedNum;             /**< number of levels cleared */
+    int cleared[MAXBLOCKNUM];   /**< cleared levels in order of removal */
+} tEngPlacement;
+
+/** Kinds of the events of the engine */
+typedef enum
+{
+    eEngEventSpawn = 0, /**< new solid: object */
+    eEngEventMove,      /**< solid moved or lowered: object */
+    eEngEventTurn,      /**< solid turned: object, arg: axis 1, axis 2, sign */
+    eEngEventLock,      /**< solid put to the space: object */
+    eEngEventClear,     /**< levels cleared: num, arg: levels in order of
+                             removal */
+    eEngEventScore,     /**< score changed: num the score, arg[0] the gain */
+    eEngEventGameOver,  /**< end of the game: num the score */
+    eEngEventNum
+} tEngEventType;
+
+/** An event of the engine */
+typedef struct
+{
+    tEngEventType type;         /**< kind of the event */
+    long          time;         /**< engine time of the event [msec] */
+    tEngObject    object;       /**< the solid after the event */
+    int           num;          /**< count or value (see the kinds) */
+    int           arg[MAXBLOCKNUM]; /**< arguments (see the kinds) */
+} tEngEvent;
+
+/** Lock-free ring of the events, written by the engine only and read by
+    a single consumer. The counters run freely, the event n is in the
+    slot n % ENGEVENTS; the events are dropped while the ring is full,
+    but for the end of the game, which has the last slot kept for it. */
+typedef struct
+{
+    tEngEvent   event[ENGEVENTS];   /**< slots of the events */
+    atomic_uint head;               /**< number of events written */
+    atomic_uint tail;               /**< number of events read */
+    unsigned    lost;               /**< number of events dropped */
+} tEngEventRing;
+
+/** Counters of the engine */
+typedef enum
+{
+    eEngCountOverlap = 0,   /**< overlap checks of the solid */
+    eEngCountTurn,          /**< turns done */
+    eEngCountTurnRejected,  /**< turns rejected */
+    eEngCountMove,          /**< moves done */
+    eEngCountMoveRejected,  /**< moves rejected */
+    eEngCountLock,          /**< solids put to the space */
+    eEngCountLevels,        /**< levels cleared */
+    eEngCountSolid,         /**< new solids */
+    eEngCountNum
+} tEngCounter;
+
+/** Timed calls of the engine */
+typedef enum
+{
+    eEngTimeLower = 0,      /**< lowering the solid (with the landing) */
+    eEngTimeTurn,           /**< turning the solid */
+    eEngTimeMove,           /**< moving the solid */
+    eEngTimeKill,           /**< deleting the full levels */
+    eEngTimeNum
+} tEngTimer;
+
+/** Performance counters of a game, the searches of the autoplayer
+    on the space are not counted */
+typedef struct
+{
+    uint64_t count[eEngCountNum];   /**< counters */
+    tPrfHist time[eEngTimeNum];     /**< durations of the calls [nsec] */
+} tEngStats;
+
 /** game options */
 typedef struct
 {
     /** difficulty level [0..2] */
     int diff;
+    /** seed of the random generator, 0 for a fresh seed in each game */
+    uint64_t seed;
+    /** flag of recording the games to replays */
+    int record;
 }
 tEngGameOptions;
 
 typedef struct sEngGame tEngGame;
 
-typedef void (*tEngGameEvent)(tEngGame *pEngGame);
+/** Autoplayer of a game (see ai.c) */
+struct sAiGamer;
 
 /** sturct of the game variables */
 struct sEngGame
 {
     /** the game space  */
-    tEngLevel space[SPACELENGTH];
+    tEngSpace space;
     /** actual object */
     tEngObject object;
+    /** ring buffer of the coming solids in their initial pose */
+    tEngObject preview[ENGPREVIEW];
+    /** index of the next solid in the preview */
+    int previewFirst;
     /** score collected in the actual game */
     int score;
+    /** number of levels cleared in the actual game */
+    int levels;
     /** flag for indicate game over */
     int gameOver;
     /** flag for indicate real user gameing (or autoplay) */
     int activeUser;
     /** counter for used objects */
     int solidnum;
-    /** engine locked while animation running */
-    int lock;
     /** engine suspended while menu on (no lowering) */
     int suspended;
-    /** levels of gamespace */
+    /** levels of gamespace (applied at reset) */
     int spaceLength;
-    /** game space level sizes (x, y, z) */
-    int size[3];
-    /** animation related variables */
+    /** game space level sizes (x, y, z) (applied at reset) */
+    int size[ENGLEVELDIM];
+    /** last change of the pose of the solid, for the display to
+        interpolate from the previous pose to the actual one */
+    struct
+    {
+        tEngObject from;    /**< the solid before the change */
+        long time;          /**< time of the change [msec], ENGNOTIME if none */
+        int axis1, axis2;   /**< plane of the turn, -1 if not turned */
+        int sign;           /**< direction of the turn */
+    } motion;
+    /** the last solid dropped, for the display to show its fall */
     struct
     {
-        int enable;             /**< animation switch */
-        int num;                /**< number of transformation have to be performed */
-        tM4dMatrix transform;   /**< transformation to be performed. */
-        tM4dVector translation; /**< translation vector */
-    } animation;
+        tEngObject object;  /**< the solid before the drop */
+        int distance;       /**< number of levels it fell */
+        long time;          /**< time of the drop [msec], ENGNOTIME if none */
+        tEngSpace space;    /**< the space before the solid landed, shown
+                                 while it falls */
+    } drop;
 
-    /** id of drop down timer */
-    int *fnID_dropdown;
-    /** id of lowering timer */
-    int *fnID_lower;
+    /** random generator of the game */
+    tRndState rnd;
+    /** seed of the actual game */
+    uint64_t seed;
+
+    /** engine clock, advanced by engStep() [msec] */
+    long time;
+    /** time of the next lowering [msec] */
+    long lowerTime;
 
     /** struct of game options */
     tEngGameOptions game_opts;
 
-    /** Event handler call back for game over */
-    tEngGameEvent onGameOver;
+    /** replay of the actual game recorded */
+    tRplReplay replay;
+
+    /** performance counters since the init */
+    tEngStats stats;
+
+    /** events of the game, to be drained by engPollEvent() */
+    tEngEventRing events;
+
+    /** autoplayer of the game, started by its first step and released
+        by aiFreeGamer(), NULL if none */
+    struct sAiGamer *pAiGamer;
 };
 
 /*------------------------------------------------------------------------------
@@ -119,12 +295,46 @@ struct sEngGame
 ------------------------------------------------------------------------------*/
 
 extern void engResetGame(tEngGame *pEngGame);
-extern void engInitGame(tEngGame *pEngGame, tEngGameEvent onGameOver);
+extern void engInitGame(tEngGame *pEngGame);
+extern void engFreeGame(tEngGame *pEngGame);
+extern void engStep(tEngGame *pEngGame, int dt);
+extern int engPollEvent(tEngEvent *pEvent, tEngGame *pEngGame);
+extern void engResetStats(tEngGame *pEngGame);
+extern void engAddStats(tEngStats *pSum, const tEngStats *pStats);
+extern void engPrintStats(FILE *file, const tEngStats *pStats);
 extern int engLowerSolid(tEngGame *pEngGame);
 extern void engDropSolid(tEngGame *pEngGame);
 extern int engTurn(char ax1, char ax2, char sign1, char sign2, tEngGame *pEngGame);
 extern int engMove(char axle, int direction, tEngGame *pEngGame);
 extern void engPrintSpace(tEngGame *pEngGame);
-extern int engGetSpaceCell(int w, int x, int y, int z, tEngGame *pEngGame);
+extern const tEngObject *engPeekSolid(int n, const tEngGame *pEngGame);
+extern uint64_t engHashSpace(const tEngObject *pObject,
+                             const tEngSpace *pSpace);
+extern uint64_t engHashState(const tEngGame *pEngGame);
+extern const tRplReplay *engEndReplay(tEngGame *pEngGame);
+extern int engPlayReplay(const tRplReplay *pReplay, tEngGame *pEngGame);
+extern int engGetCell(const int cell[ENGDIM], const tEngSpace *pSpace);
+extern void engCopySpace(tEngSpace *pDst, const tEngSpace *pSrc);
+extern void engFreeSpace(tEngSpace *pSpace);
+extern int engObject2Cells(const tEngObject *pObject,
+                           tEngCells *pCells,
+                           const tEngSpace *pSpace);
+extern int engOverlapping(const tEngObject *pObject, const tEngSpace *pSpace);
+extern int engDropDistance(const tEngObject *pObject, const tEngSpace *pSpace);
+extern void engFillCells(const tEngCells *pCells,
+                         tEngPlacement *pPlacement,
+                         tEngSpace *pSpace);
+extern void engKillFullLevels(tEngPlacement *pPlacement, tEngSpace *pSpace);
+extern int engPlaceCells(const tEngCells *pCells,
+                         tEngPlacement *pPlacement,
+                         tEngSpace *pSpace);
+extern void engUndoPlacement(const tEngPlacement *pPlacement,
+                             tEngSpace *pSpace);
+
+/*  display of the 4D game */
+#if ENGDIM == 4
+extern const tEngBlocks *engGetSolidPose(tM4dVector *pPos, tM4dMatrix *pAxices,
+                                         const tEngObject *pObject);
+#endif
 
 #endif
@@ -31,6 +31,7 @@
 
 #include "m3d.h"
 #include "m4d.h"
+#include "rpl.h"
 #include "eng.h"
 #include "ai.h"
 #include "scn.h"
@@ -51,8 +52,29 @@
 
 static int debugmode = 0;
 
+/** seed of the games given in command line, 0 if not given */
+static unsigned long seedArg = 0;
+
+/** flag of printing the performance counters of the engine at exit */
+static int statsArg = 0;
+
+/** the game played */
+static tEngGame engGame;
+
 static const int framerate = 50;
 
+/** Fixed time step of the game engine and the autoplayer [msec] */
+static const int engineTimeStep = 5;
+
+/** Longest time simulated in a frame, the rest is dropped [msec] */
+static const int engineMaxFrameTime = 250;
+
+/** SDL ticks at the last update of the game engine */
+static Uint32 engineTicks;
+
+/** Time passed but not yet simulated [msec] */
+static int engineTimeAcc = 0;
+
 static SDL_Surface *screen;
 
 /*
@@ -63,6 +85,8 @@ static SDL_Surface *screen;
 
 static void processARGV(int argc, char *argv[]);
 static void onGameOver(tEngGame *pEngGame);
+static void engineUpdate(tEngGame *pEngGame);
+static void engineEvents(tEngGame *pEngGame);
 static void terminate(void);
 static void resize(int w, int h);
 
@@ -93,9 +117,58 @@ static void onGameOver(tEngGame *pEngGame)
 
     hstAddScore(pEngGame->score);
 
+    /*  keep the replay of the last game */
+    rplSave(engEndReplay(pEngGame), confUserFilename("ntris-replay"));
+
     menuGotoItem(eMenuGameOver);
 }
 
+/** Drains the events of the game engine queued since the last frame */
+static void engineEvents(tEngGame *pEngGame)
+{
+    tEngEvent event;
+
+    while (engPollEvent(&event, pEngGame))
+    {
+        switch (event.type)
+        {
+        case eEngEventGameOver:
+        {
+            onGameOver(pEngGame);
+            break;
+        }
+        default:
+            break;
+        }
+    }
+}
+
+/** Simulates the time passed since the last update in fixed steps,
+ *  the game engine first, then the autoplayer in each step. */
+static void engineUpdate(tEngGame *pEngGame)
+{
+    Uint32 ticks = SDL_GetTicks();
+    int elapsed = ticks - engineTicks;
+
+    engineTicks = ticks;
+
+    /*  do not try to catch up a long stall */
+    if (elapsed > engineMaxFrameTime)
+    {
+        elapsed = engineMaxFrameTime;
+    }
+
+    engineTimeAcc += elapsed;
+
+    while (engineTimeAcc >= engineTimeStep)
+    {
+        engStep(pEngGame, engineTimeStep);
+        aiStep(pEngGame, engineTimeStep);
+
+        engineTimeAcc -= engineTimeStep;
+    }
+}
+
 /** Process command line arguments */
 static void processARGV(int argc, char *argv[])
 {
@@ -107,6 +180,14 @@ static void processARGV(int argc, char *argv[])
         {
             debugmode = 1;
         }
+        if ((strcmp (argv[i], "--seed") == 0) && (i + 1 < argc))
+        {
+            seedArg = strtoul(argv[++i], NULL, 0);
+        }
+        if (strcmp (argv[i], "--stats") == 0)
+        {
+            statsArg = 1;
+        }
     }
 }
 
@@ -118,6 +199,14 @@ static void terminate(void)
 
     confSave(confUserFilename("ntris"));
 
+    /*  stop the planner of the autoplayer */
+    aiFreeGamer(&engGame);
+
+    if (statsArg)
+    {
+        engPrintStats(stdout, &engGame.stats);
+    }
+
     exit(0);
 }
 
@@ -133,8 +222,8 @@ int main(int argc, char *argv[])
     SDLMod mods;
     int uiKey;
     int w, h, ok, temp;
+    uint64_t seed;
 
-    tEngGame engGame, engGameDraw;
     tScnSet scnSet = scnGetDefaultSet(), scnSetDraw;
 
     processARGV(argc, argv);
@@ -145,7 +234,7 @@ int main(int argc, char *argv[])
     setlocale(LC_ALL, "");
 
     /*  Initialize the game engine. */
-    engInitGame(&engGame, &onGameOver);
+    engInitGame(&engGame);
     {
         temp = confGetVar("spaceLength", &ok);
         if (ok)
@@ -167,15 +256,19 @@ int main(int argc, char *argv[])
         {
             engGame.size[2] = temp;
         }
-        temp = confGetVar("animation_enable", &ok);
+        temp = confGetVar("game_opts_diff", &ok);
         if (ok)
         {
-            engGame.animation.enable = temp;
+            engGame.game_opts.diff = temp;
         }
-        temp = confGetVar("game_opts_diff", &ok);
+        seed = confGetUnsigned("seed", &ok);
         if (ok)
         {
-            engGame.game_opts.diff = temp;
+            engGame.game_opts.seed = seed;
+        }
+        if (seedArg != 0)
+        {
+            engGame.game_opts.seed = seedArg;
         }
 
         engResetGame(&engGame);
@@ -207,6 +300,11 @@ int main(int argc, char *argv[])
         {
             scnSet.viewMode = temp;
         }
+        temp = confGetVar("animation_enable", &ok);
+        if (ok)
+        {
+            scnSet.enableAnimation = temp;
+        }
     }
 
     SDL_Init(SDL_INIT_VIDEO|SDL_INIT_TIMER);
@@ -250,7 +348,13 @@ int main(int argc, char *argv[])
     menuInit(&engGame, &scnSet);
     menuSetOnActivate(eMenuQuit, &terminate);
 
-    /*  start autoplayer */
+    /*  start the clock of the game engine */
+    engineTicks = SDL_GetTicks();
+
+    /*  start autoplayer, searching on every processor if not configured */
+    temp = confGetVar("ai_threads", &ok);
+    aiSetThreads(ok ? temp : 0);
+    aiLoadConf();
     aiSetActive(1, &engGame);
 
     resize(screen->w, screen->h);
@@ -503,9 +607,14 @@ int main(int argc, char *argv[])
             }
         }
 
-        engGameDraw = engGame;
+        /*  advance the game, handle its events, then draw it */
+        engineUpdate(&engGame);
+        engineEvents(&engGame);
+
+        /*  the motions shown at the time of the frame, with the time
+            not yet simulated by the engine */
         scnSetDraw  = scnSet;
-        scnDisplay(&engGameDraw, &scnSetDraw);
+        scnDisplay(engGame.time + engineTimeAcc, &engGame, &scnSetDraw);
 
         endFrame = SDL_GetTicks();
 
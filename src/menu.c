@@ -514,11 +514,11 @@ static void menuBack(void)
 
 static void menuAnimation(void)
 {
-    pMenuEngGame->animation.enable = !pMenuEngGame->animation.enable;
+    scnSetEnableAnimation(!scnGetEnableAnimation(pMenuScnSet), pMenuScnSet);
 
-    confSetVar("animation_enable", pMenuEngGame->animation.enable);
+    confSetVar("animation_enable", pMenuScnSet->enableAnimation);
 
-    menuItems[eMenuAnimation].caption = (pMenuEngGame->animation.enable)
+    menuItems[eMenuAnimation].caption = scnGetEnableAnimation(pMenuScnSet)
     ? "Animation - ON"
     : "Animation - OFF";
     menuNavigate(eMenuBack);
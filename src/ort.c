@@ -0,0 +1,221 @@
+/**
+ * \file  ort.c
+ * \brief Integer orientation tables.
+ *
+ *  Quarter turns of an axis aligned object only ever produce signed
+ *  permutation matrices. Each of them gets an index, and turns are
+ *  performed by table lookup instead of floating point matrix products.
+ */
+
+/*------------------------------------------------------------------------------
+   INCLUDE FILES
+------------------------------------------------------------------------------*/
+
+#include "ort.h"
+
+/*------------------------------------------------------------------------------
+   MACROS
+------------------------------------------------------------------------------*/
+
+/** Number of permutations of the axices */
+#define ORTPERMNUM (ORTNUM >> ORTDIM)
+
+/** Number of lookup keys: the permutation digits but the last one
+    (that is given by the others) and the sign bits */
+#if ORTDIM == 3
+#define ORTKEYNUM (3 * 3 << 3)
+#elif ORTDIM == 4
+#define ORTKEYNUM (4 * 4 * 4 << 4)
+#else
+#define ORTKEYNUM (5 * 5 * 5 * 5 << 5)
+#endif
+
+/*------------------------------------------------------------------------------
+   TYPES
+------------------------------------------------------------------------------*/
+
+/** Signed permutation matrix: row r has its only nonzero element
+    sign[r] in the column axis[r] */
+typedef struct
+{
+    signed char axis[ORTDIM]; /**< column of the nonzero element of the rows */
+    signed char sign[ORTDIM]; /**< value (+1/-1) of the nonzero element */
+} tOrtMatrix;
+
+/*------------------------------------------------------------------------------
+   GLOBAL VARIABLES
+------------------------------------------------------------------------------*/
+
+/** flag for tables already built */
+static int ortInitialized = 0;
+
+/** orientation matrices by index */
+static tOrtMatrix ortMatrices[ORTNUM];
+
+/** index of orientations by lookup key */
+static short ortKeys[ORTKEYNUM];
+
+/** result of the positive quarter turn from axis 1 to axis 2 */
+static short ortTurns[ORTNUM][ORTDIM][ORTDIM];
+
+/*------------------------------------------------------------------------------
+   PROTOTYPES
+------------------------------------------------------------------------------*/
+
+static int ortKey(const tOrtMatrix *pMatrix);
+static int ortNextPerm(signed char perm[ORTDIM]);
+
+/*------------------------------------------------------------------------------
+   FUNCTIONS
+------------------------------------------------------------------------------*/
+
+/** Lookup key of a matrix */
+static int ortKey(const tOrtMatrix *pMatrix)
+{
+    int row;
+    int key = 0;
+
+    for (row = 0; row < ORTDIM - 1; row++)
+    {
+        key = key * ORTDIM + pMatrix->axis[row];
+    }
+
+    for (row = 0; row < ORTDIM; row++)
+    {
+        key = key * 2 + (pMatrix->sign[row] < 0);
+    }
+
+    return(key);
+}
+
+/** Steps to the lexicographically next permutation.
+ *  \return 0 if the last permutation was passed */
+static int ortNextPerm(signed char perm[ORTDIM])
+{
+    int i, j;
+    signed char temp;
+
+    i = ORTDIM - 2;
+    while ((i >= 0) && (perm[i] > perm[i+1]))
+    {
+        i--;
+    }
+
+    if (i < 0)
+    {
+        return(0);
+    }
+
+    j = ORTDIM - 1;
+    while (perm[j] < perm[i])
+    {
+        j--;
+    }
+
+    temp = perm[i];
+    perm[i] = perm[j];
+    perm[j] = temp;
+
+    /*  reverse the tail */
+    for (i++, j = ORTDIM - 1; i < j; i++, j--)
+    {
+        temp = perm[i];
+        perm[i] = perm[j];
+        perm[j] = temp;
+    }
+
+    return(1);
+}
+
+/** Builds the orientation and turn tables. */
+void ortInit(void)
+{
+    int o, p, mask, row, ax1, ax2;
+    signed char perm[ORTDIM];
+    tOrtMatrix turned;
+
+    if (ortInitialized)
+    {
+        return;
+    }
+
+    for (row = 0; row < ORTDIM; row++)
+    {
+        perm[row] = row;
+    }
+
+    /*  identity permutation first, so the unit matrix gets index 0 */
+    for (p = 0; p < ORTPERMNUM; p++)
+    {
+        for (mask = 0; mask < (1 << ORTDIM); mask++)
+        {
+            o = (p << ORTDIM) | mask;
+
+            for (row = 0; row < ORTDIM; row++)
+            {
+                ortMatrices[o].axis[row] = perm[row];
+                ortMatrices[o].sign[row] = (mask & (1 << row)) ? -1 : 1;
+            }
+
+            ortKeys[ortKey(&ortMatrices[o])] = o;
+        }
+
+        ortNextPerm(perm);
+    }
+
+    /*  the quarter turn in plane (ax1, ax2) maps row ax1 to -row ax2
+        and row ax2 to row ax1 */
+    for (o = 0; o < ORTNUM; o++)
+        for (ax1 = 0; ax1 < ORTDIM; ax1++)
+            for (ax2 = 0; ax2 < ORTDIM; ax2++)
+            {
+                turned = ortMatrices[o];
+
+                if (ax1 != ax2)
+                {
+                    turned.axis[ax1] = ortMatrices[o].axis[ax2];
+                    turned.sign[ax1] = -ortMatrices[o].sign[ax2];
+                    turned.axis[ax2] = ortMatrices[o].axis[ax1];
+                    turned.sign[ax2] = ortMatrices[o].sign[ax1];
+                }
+
+                ortTurns[o][ax1][ax2] = ortKeys[ortKey(&turned)];
+            }
+
+    ortInitialized = 1;
+}
+
+/** Index of the orientation given by the columns and signs of its rows */
+int ortIndex(const int axis[ORTDIM], const int sign[ORTDIM])
+{
+    int row;
+    tOrtMatrix matrix;
+
+    for (row = 0; row < ORTDIM; row++)
+    {
+        matrix.axis[row] = axis[row];
+        matrix.sign[row] = (sign[row] < 0) ? -1 : 1;
+    }
+
+    return(ortKeys[ortKey(&matrix)]);
+}
+
+/** Orientation after a quarter turn from axis 1 to axis 2
+ *  (negative sign turns backward). */
+int ortTurn(int orient, int axis1, int axis2, int sign)
+{
+    return((sign >= 0) ? ortTurns[orient][axis1][axis2]
+           : ortTurns[orient][axis2][axis1]);
+}
+
+/** Column of the nonzero element in a row of the orientation matrix */
+int ortAxis(int orient, int row)
+{
+    return(ortMatrices[orient].axis[row]);
+}
+
+/** Sign of the nonzero element in a row of the orientation matrix */
+int ortSign(int orient, int row)
+{
+    return(ortMatrices[orient].sign[row]);
+}
@@ -0,0 +1,45 @@
+/**
+ * \file  ort.h
+ * \brief Header for the integer orientation tables.
+ */
+
+#ifndef _ORT_H_
+#define _ORT_H_
+
+/*------------------------------------------------------------------------------
+   MACROS
+------------------------------------------------------------------------------*/
+
+/** Dimension of the game, set at compile time (3, 4 or 5) */
+#ifndef ENGDIM
+#define ENGDIM 4
+#endif
+
+/** Number of coordinate axices of the oriented objects */
+#define ORTDIM ENGDIM
+
+/** Number of orientations (signed permutation matrices): 2^n * n! */
+#if ORTDIM == 3
+#define ORTNUM 48
+#elif ORTDIM == 4
+#define ORTNUM 384
+#elif ORTDIM == 5
+#define ORTNUM 3840
+#else
+#error "ENGDIM must be 3, 4 or 5"
+#endif
+
+/** Index of the unit orientation */
+#define ORTUNIT 0
+
+/*------------------------------------------------------------------------------
+   DECLARATIONS
+------------------------------------------------------------------------------*/
+
+extern void ortInit(void);
+extern int ortIndex(const int axis[ORTDIM], const int sign[ORTDIM]);
+extern int ortTurn(int orient, int axis1, int axis2, int sign);
+extern int ortAxis(int orient, int row);
+extern int ortSign(int orient, int row);
+
+#endif /* _ORT_H_ */
@@ -0,0 +1,122 @@
+/**
+ * \file  prf.c
+ * \brief Performance counters: monotonic clock and latency histograms.
+ *
+ *  The histograms are kept in fixed buckets of powers of two, so adding a
+ *  duration is a few instructions, and the quantiles are read as the
+ *  upper bounds of the buckets they fall in (within a factor of two).
+ */
+
+/*------------------------------------------------------------------------------
+   INCLUDE FILES
+------------------------------------------------------------------------------*/
+
+#include <time.h>
+
+#include "prf.h"
+
+/*------------------------------------------------------------------------------
+   FUNCTIONS
+------------------------------------------------------------------------------*/
+
+/** Monotonic clock
+ *  \return time [nsec] since an arbitrary start */
+uint64_t prfNow(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return((uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec);
+}
+
+/** Counts a duration [nsec] in a histogram */
+void prfHistAdd(tPrfHist *pHist, uint64_t duration)
+{
+    int i = 0;
+
+    /*  bucket of the highest bit set */
+    while ((i < PRFBUCKETS - 1) && ((duration >> (i + 1)) != 0))
+    {
+        i++;
+    }
+
+    pHist->bucket[i]++;
+    pHist->num++;
+    pHist->total += duration;
+
+    if (duration > pHist->max)
+    {
+        pHist->max = duration;
+    }
+}
+
+/** Adds the durations of a histogram to another one */
+void prfHistMerge(tPrfHist *pSum, const tPrfHist *pHist)
+{
+    int i;
+
+    for (i = 0; i < PRFBUCKETS; i++)
+    {
+        pSum->bucket[i] += pHist->bucket[i];
+    }
+
+    pSum->num   += pHist->num;
+    pSum->total += pHist->total;
+
+    if (pHist->max > pSum->max)
+    {
+        pSum->max = pHist->max;
+    }
+}
+
+/** Quantile of the durations, e.g. q = 0.99 for the 99th percentile
+ *  \return upper bound of the bucket of the quantile [nsec],
+ *          0 if no durations */
+uint64_t prfHistQuantile(const tPrfHist *pHist, double q)
+{
+    uint64_t rank, sum = 0;
+    int i;
+
+    if (pHist->num == 0)
+    {
+        return(0);
+    }
+
+    rank = (uint64_t)(q * pHist->num);
+    if (rank >= pHist->num)
+    {
+        rank = pHist->num - 1;
+    }
+
+    for (i = 0; i < PRFBUCKETS - 1; i++)
+    {
+        sum += pHist->bucket[i];
+
+        if (sum > rank)
+        {
+            break;
+        }
+    }
+
+    /*  not beyond the longest one */
+    if ((i == PRFBUCKETS - 1) || (((uint64_t)2 << i) > pHist->max))
+    {
+        return(pHist->max);
+    }
+
+    return((uint64_t)2 << i);
+}
+
+/** Prints a line of the number, mean, median, 99th percentile and maximum
+ *  of the durations [nsec] of a histogram */
+void prfHistPrint(FILE *file, const char *name, const tPrfHist *pHist)
+{
+    fprintf(file, "%-16s %10llu %10.0f %10llu %10llu %10llu\n",
+            name,
+            (unsigned long long)pHist->num,
+            (pHist->num > 0) ? (double)pHist->total / pHist->num : 0.0,
+            (unsigned long long)prfHistQuantile(pHist, 0.5),
+            (unsigned long long)prfHistQuantile(pHist, 0.99),
+            (unsigned long long)pHist->max);
+}
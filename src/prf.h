@@ -0,0 +1,49 @@
+/**
+ * \file  prf.h
+ * \brief Header for the performance counters: clock and latency histograms.
+ */
+
+#ifndef _PRF_H_
+#define _PRF_H_
+
+/*------------------------------------------------------------------------------
+   INCLUDES
+------------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdint.h>
+
+/*------------------------------------------------------------------------------
+   MACROS
+------------------------------------------------------------------------------*/
+
+/** Number of the buckets of a histogram: bucket i counts the durations
+    of [2^i, 2^(i+1)) nsec, the first one the shorter, the last one the
+    longer ones too */
+#define PRFBUCKETS 32
+
+/*------------------------------------------------------------------------------
+   TYPES
+------------------------------------------------------------------------------*/
+
+/** Histogram of durations [nsec] in buckets of powers of two */
+typedef struct
+{
+    uint64_t num;                   /**< number of the durations */
+    uint64_t total;                 /**< sum of the durations */
+    uint64_t max;                   /**< longest duration */
+    uint64_t bucket[PRFBUCKETS];    /**< number of the durations by bucket */
+} tPrfHist;
+
+/*------------------------------------------------------------------------------
+   DECLARATIONS
+------------------------------------------------------------------------------*/
+
+extern uint64_t prfNow(void);
+
+extern void prfHistAdd(tPrfHist *pHist, uint64_t duration);
+extern void prfHistMerge(tPrfHist *pSum, const tPrfHist *pHist);
+extern uint64_t prfHistQuantile(const tPrfHist *pHist, double q);
+extern void prfHistPrint(FILE *file, const char *name, const tPrfHist *pHist);
+
+#endif /* _PRF_H_ */
@@ -0,0 +1,88 @@
+/**
+ * \file  replay.c
+ * \brief Headless replayer checking recorded games.
+ *
+ *  Plays the replays given again as fast as possible, without graphics
+ *  and timing, and checks the hash of the final state of each game
+ *  against the recorded one. Reports the outcome and the time of each
+ *  replay, fails if any of them differs.
+ */
+
+/*------------------------------------------------------------------------------
+   INCLUDE FILES
+------------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "m3d.h"
+#include "m4d.h"
+#include "rpl.h"
+#include "eng.h"
+
+/*------------------------------------------------------------------------------
+   FUNCTIONS
+------------------------------------------------------------------------------*/
+
+/** Wall clock time [sec] */
+static double replaySeconds(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return(ts.tv_sec + ts.tv_nsec * 1e-9);
+}
+
+/** Main function of the replayer */
+int main(int argc, char *argv[])
+{
+    static const char *results[3] = {"invalid", "MISMATCH", "ok"};
+    int i, result;
+    int num = 0, failed = 0;
+    double start, elapsed, total = 0.0;
+    tRplReplay replay;
+    tEngGame game;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s REPLAY...\n", argv[0]);
+        return(1);
+    }
+
+    rplInit(&replay);
+    engInitGame(&game);
+
+    printf("# replay result score solids levels usec\n");
+
+    for (i = 1; i < argc; i++)
+    {
+        if (rplLoad(&replay, argv[i]) != 0)
+        {
+            fprintf(stderr, "%s: cannot read %s\n", argv[0], argv[i]);
+            failed++;
+            continue;
+        }
+
+        start   = replaySeconds();
+        result  = engPlayReplay(&replay, &game);
+        elapsed = replaySeconds() - start;
+
+        printf("%s %s %d %d %d %.0f\n", argv[i], results[result + 1],
+               game.score, game.solidnum, game.levels, elapsed * 1e6);
+
+        num++;
+        total  += elapsed;
+        failed += (result != 1);
+    }
+
+    printf("# %dD, replays %d, failed %d, %.3f s\n",
+           ENGDIM, num, failed, total);
+
+    engFreeGame(&game);
+    rplFree(&replay);
+
+    return((failed > 0) ? 1 : 0);
+}
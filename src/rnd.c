@@ -0,0 +1,157 @@
+/**
+ * \file  rnd.c
+ * \brief Seedable random number generator.
+ *
+ *  Small, fast generator (xoshiro256**) with its whole state in a struct,
+ *  so every game can own a reproducible stream of random numbers.
+ */
+
+/*------------------------------------------------------------------------------
+   INCLUDE FILES
+------------------------------------------------------------------------------*/
+
+#include "rnd.h"
+
+/*------------------------------------------------------------------------------
+   PROTOTYPES
+------------------------------------------------------------------------------*/
+
+static uint64_t rndRotl(uint64_t x, int k);
+static uint64_t rndSplitMix(uint64_t *pSeed);
+
+/*------------------------------------------------------------------------------
+   FUNCTIONS
+------------------------------------------------------------------------------*/
+
+/** Rotates the bits of x left by k */
+static uint64_t rndRotl(uint64_t x, int k)
+{
+    return((x << k) | (x >> (64 - k)));
+}
+
+/** Next output of the splitmix64 generator used for seeding */
+static uint64_t rndSplitMix(uint64_t *pSeed)
+{
+    uint64_t z = (*pSeed += 0x9e3779b97f4a7c15ULL);
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+
+    return(z ^ (z >> 31));
+}
+
+/** Initialises the generator state from a seed value */
+void rndSeed(tRndState *pRnd, uint64_t seed)
+{
+    int i;
+
+    for (i = 0; i < 4; i++)
+    {
+        pRnd->s[i] = rndSplitMix(&seed);
+    }
+}
+
+/** Next 64 bit random number */
+uint64_t rndNext(tRndState *pRnd)
+{
+    uint64_t *s = pRnd->s;
+    uint64_t result = rndRotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+
+    s[2] ^= t;
+
+    s[3] = rndRotl(s[3], 45);
+
+    return(result);
+}
+
+/** Random integer in range [0, n) */
+int rndRange(tRndState *pRnd, int n)
+{
+    return((int)(((rndNext(pRnd) >> 32) * (uint64_t)n) >> 32));
+}
+
+/** Builds the alias table of outcomes with the given integer weights */
+void rndInitAlias(tRndAlias *pAlias, const int weights[], int num)
+{
+    /*  weights scaled by the number of outcomes,
+        the average column is filled up to the total */
+    uint32_t scaled[RNDALIASMAX];
+    int small[RNDALIASMAX];
+    int large[RNDALIASMAX];
+    int smallNum = 0;
+    int largeNum = 0;
+    int i, s, l;
+
+    pAlias->num   = num;
+    pAlias->total = 0;
+
+    for (i = 0; i < num; i++)
+    {
+        pAlias->total += weights[i];
+    }
+
+    for (i = 0; i < num; i++)
+    {
+        scaled[i] = weights[i] * num;
+
+        if (scaled[i] < pAlias->total)
+        {
+            small[smallNum++] = i;
+        }
+        else
+        {
+            large[largeNum++] = i;
+        }
+    }
+
+    /*  fill up each small column from a large one */
+    while ((smallNum > 0) && (largeNum > 0))
+    {
+        s = small[--smallNum];
+        l = large[--largeNum];
+
+        pAlias->prob[s]  = scaled[s];
+        pAlias->alias[s] = l;
+
+        scaled[l] -= pAlias->total - scaled[s];
+
+        if (scaled[l] < pAlias->total)
+        {
+            small[smallNum++] = l;
+        }
+        else
+        {
+            large[largeNum++] = l;
+        }
+    }
+
+    /*  remaining columns are full */
+    while (largeNum > 0)
+    {
+        l = large[--largeNum];
+        pAlias->prob[l]  = pAlias->total;
+        pAlias->alias[l] = l;
+    }
+    while (smallNum > 0)
+    {
+        s = small[--smallNum];
+        pAlias->prob[s]  = pAlias->total;
+        pAlias->alias[s] = s;
+    }
+}
+
+/** Random outcome sampled from an alias table */
+int rndAlias(tRndState *pRnd, const tRndAlias *pAlias)
+{
+    uint64_t x = rndNext(pRnd);
+    int column = (int)(((x >> 32) * (uint64_t)pAlias->num) >> 32);
+    uint32_t threshold = (uint32_t)(((x & 0xffffffffULL) * pAlias->total) >> 32);
+
+    return((threshold < pAlias->prob[column]) ? column : pAlias->alias[column]);
+}
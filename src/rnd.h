@@ -0,0 +1,52 @@
+/**
+ * \file  rnd.h
+ * \brief Header for the seedable random number generator.
+ */
+
+#ifndef _RND_H_
+#define _RND_H_
+
+/*------------------------------------------------------------------------------
+   INCLUDES
+------------------------------------------------------------------------------*/
+
+#include <stdint.h>
+
+/*------------------------------------------------------------------------------
+   MACROS
+------------------------------------------------------------------------------*/
+
+/** Maximal number of outcomes of an alias table */
+#define RNDALIASMAX 16
+
+/*------------------------------------------------------------------------------
+   TYPES
+------------------------------------------------------------------------------*/
+
+/** State of a random number generator (xoshiro256**) */
+typedef struct
+{
+    uint64_t s[4];
+} tRndState;
+
+/** Alias table for sampling weighted outcomes in constant time */
+typedef struct
+{
+    int      num;                 /**< number of outcomes */
+    uint32_t total;               /**< sum of the weights */
+    uint32_t prob[RNDALIASMAX];   /**< threshold of keeping the column */
+    int      alias[RNDALIASMAX];  /**< outcome if threshold exceeded */
+} tRndAlias;
+
+/*------------------------------------------------------------------------------
+   DECLARATIONS
+------------------------------------------------------------------------------*/
+
+extern void rndSeed(tRndState *pRnd, uint64_t seed);
+extern uint64_t rndNext(tRndState *pRnd);
+extern int rndRange(tRndState *pRnd, int n);
+
+extern void rndInitAlias(tRndAlias *pAlias, const int weights[], int num);
+extern int rndAlias(tRndState *pRnd, const tRndAlias *pAlias);
+
+#endif /* _RND_H_ */
@@ -0,0 +1,369 @@
+/**
+ * \file  rpl.c
+ * \brief Compact binary replays of games.
+ *
+ *  A replay is the seed and the parameters of a game followed by its
+ *  inputs in order of time. Every record is the time passed since the
+ *  previous one, its kind and its arguments, all as variable length
+ *  integers (7 bits a byte, low bits first), so most records take two
+ *  or three bytes. The last record is the hash of the final state.
+ */
+
+/*------------------------------------------------------------------------------
+   INCLUDE FILES
+------------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+
+#include "rpl.h"
+
+/*------------------------------------------------------------------------------
+   CONSTANTS
+------------------------------------------------------------------------------*/
+
+/** Identifier at the start of the replays */
+static const unsigned char rplMagic[4] = {'N', 'T', 'R', 'P'};
+
+/** Version of the encoding */
+static const int rplVersion = 1;
+
+/** Number of the arguments of the kinds of records */
+static const int rplArgNum[eRplOpNum] =
+{
+    0, /* end */
+    3, /* turn */
+    2, /* move */
+    0, /* lower */
+    0, /* drop */
+    1  /* flags */
+};
+
+/*------------------------------------------------------------------------------
+   PROTOTYPES
+------------------------------------------------------------------------------*/
+
+static void rplPutByte(tRplReplay *pReplay, unsigned char byte);
+static void rplPutVarint(tRplReplay *pReplay, uint64_t value);
+static void rplPutSigned(tRplReplay *pReplay, long value);
+static int rplGetVarint(tRplReader *pReader, uint64_t *pValue);
+static int rplGetSigned(tRplReader *pReader, long *pValue);
+
+/*------------------------------------------------------------------------------
+   FUNCTIONS
+------------------------------------------------------------------------------*/
+
+/** Appends a byte to the replay, growing its buffer */
+static void rplPutByte(tRplReplay *pReplay, unsigned char byte)
+{
+    if (pReplay->len == pReplay->cap)
+    {
+        pReplay->cap  = (pReplay->cap > 0) ? 2 * pReplay->cap : 256;
+        pReplay->data = realloc(pReplay->data, pReplay->cap);
+
+        if (pReplay->data == NULL)
+        {
+            fprintf(stderr, "Out of memory for the replay\n");
+            exit(1);
+        }
+    }
+
+    pReplay->data[pReplay->len++] = byte;
+}
+
+/** Appends an unsigned variable length integer */
+static void rplPutVarint(tRplReplay *pReplay, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        rplPutByte(pReplay, (unsigned char)(value | 0x80));
+        value >>= 7;
+    }
+
+    rplPutByte(pReplay, (unsigned char)value);
+}
+
+/** Appends a signed variable length integer (zigzag encoded) */
+static void rplPutSigned(tRplReplay *pReplay, long value)
+{
+    rplPutVarint(pReplay, (value < 0) ? ((uint64_t)(-(value + 1)) << 1) | 1
+                                      : (uint64_t)value << 1);
+}
+
+/** Reads an unsigned variable length integer
+ *  \return 0 if ok, -1 if truncated */
+static int rplGetVarint(tRplReader *pReader, uint64_t *pValue)
+{
+    const tRplReplay *pReplay = pReader->pReplay;
+    unsigned char byte;
+    int shift = 0;
+
+    *pValue = 0;
+
+    do
+    {
+        if ((pReader->pos >= pReplay->len) || (shift > 63))
+        {
+            return(-1);
+        }
+
+        byte = pReplay->data[pReader->pos++];
+        *pValue |= (uint64_t)(byte & 0x7f) << shift;
+        shift += 7;
+    }
+    while (byte & 0x80);
+
+    return(0);
+}
+
+/** Reads a signed variable length integer
+ *  \return 0 if ok, -1 if truncated */
+static int rplGetSigned(tRplReader *pReader, long *pValue)
+{
+    uint64_t value;
+
+    if (rplGetVarint(pReader, &value) != 0)
+    {
+        return(-1);
+    }
+
+    *pValue = (value & 1) ? -(long)(value >> 1) - 1 : (long)(value >> 1);
+
+    return(0);
+}
+
+/** Initialises an empty replay */
+void rplInit(tRplReplay *pReplay)
+{
+    pReplay->data  = NULL;
+    pReplay->len   = 0;
+    pReplay->cap   = 0;
+    pReplay->time  = 0;
+    pReplay->flags = -1;
+    pReplay->ended = 1;
+}
+
+/** Releases the buffer of a replay */
+void rplFree(tRplReplay *pReplay)
+{
+    free(pReplay->data);
+    rplInit(pReplay);
+}
+
+/** Starts recording a new game at a time, dropping the previous records */
+void rplBegin(tRplReplay *pReplay, const tRplHeader *pHeader, long time)
+{
+    int i;
+
+    pReplay->len   = 0;
+    pReplay->time  = time;
+    pReplay->flags = -1;
+    pReplay->ended = 0;
+
+    for (i = 0; i < 4; i++)
+    {
+        rplPutByte(pReplay, rplMagic[i]);
+    }
+    rplPutByte(pReplay, rplVersion);
+
+    rplPutVarint(pReplay, pHeader->dim);
+    rplPutVarint(pReplay, pHeader->seed);
+    rplPutVarint(pReplay, pHeader->diff);
+    rplPutVarint(pReplay, pHeader->length);
+
+    for (i = 0; i < pHeader->dim - 1; i++)
+    {
+        rplPutVarint(pReplay, pHeader->size[i]);
+    }
+}
+
+/** Appends a record, the end record closes the replay */
+void rplPut(tRplReplay *pReplay, const tRplOp *pOp)
+{
+    int i;
+
+    if (pReplay->ended)
+    {
+        return;
+    }
+
+    rplPutVarint(pReplay, pOp->time - pReplay->time);
+    rplPutByte(pReplay, pOp->type);
+
+    for (i = 0; i < rplArgNum[pOp->type]; i++)
+    {
+        rplPutSigned(pReplay, pOp->arg[i]);
+    }
+
+    if (pOp->type == eRplOpEnd)
+    {
+        rplPutVarint(pReplay, pOp->hash);
+        pReplay->ended = 1;
+    }
+
+    pReplay->time = pOp->time;
+}
+
+/** Starts reading a replay, decoding its header. The sizes of the
+ *  space are checked against the limits (RPLMAXLENGTH, ...).
+ *  \return 0 if ok, -1 if not a valid replay */
+int rplOpen(tRplReader *pReader, tRplHeader *pHeader,
+            const tRplReplay *pReplay)
+{
+    uint64_t value[4];
+    uint64_t cells;
+    int i;
+
+    pReader->pReplay = pReplay;
+    pReader->pos     = 5;
+    pReader->time    = 0;
+
+    if (   (pReplay->len < 5)
+        || (memcmp(pReplay->data, rplMagic, 4) != 0)
+        || (pReplay->data[4] != rplVersion))
+    {
+        return(-1);
+    }
+
+    for (i = 0; i < 4; i++)
+    {
+        if (rplGetVarint(pReader, &value[i]) != 0)
+        {
+            return(-1);
+        }
+    }
+
+    /*  checked before narrowed to int */
+    if (   (value[0] < 2) || (value[0] > RPLMAXDIM + 1)
+        || (value[2] > INT_MAX)
+        || (value[3] < 2) || (value[3] > RPLMAXLENGTH))
+    {
+        return(-1);
+    }
+
+    pHeader->dim    = value[0];
+    pHeader->seed   = value[1];
+    pHeader->diff   = value[2];
+    pHeader->length = value[3];
+
+    /*  sizes checked one by one, their products not to overflow */
+    cells = 1;
+    for (i = 0; i < pHeader->dim - 1; i++)
+    {
+        if (   (rplGetVarint(pReader, &value[0]) != 0)
+            || (value[0] < 2) || (value[0] > RPLMAXLEVELCELLS))
+        {
+            return(-1);
+        }
+        cells *= value[0];
+        if (cells > RPLMAXLEVELCELLS)
+        {
+            return(-1);
+        }
+        pHeader->size[i] = value[0];
+    }
+
+    if (cells * pHeader->length > RPLMAXCELLS)
+    {
+        return(-1);
+    }
+
+    return(0);
+}
+
+/** Reads the next record of a replay
+ *  \return 1 if read, 0 at the end of the data, -1 if corrupt */
+int rplRead(tRplReader *pReader, tRplOp *pOp)
+{
+    uint64_t value;
+    long arg;
+    int i;
+
+    if (pReader->pos >= pReader->pReplay->len)
+    {
+        return(0);
+    }
+
+    /*  the time since the previous record, to be stepped by an int */
+    if (   (rplGetVarint(pReader, &value) != 0)
+        || (value > INT_MAX))
+    {
+        return(-1);
+    }
+    pReader->time += value;
+    pOp->time = pReader->time;
+
+    if (   (rplGetVarint(pReader, &value) != 0)
+        || (value >= eRplOpNum))
+    {
+        return(-1);
+    }
+    pOp->type = value;
+
+    for (i = 0; i < rplArgNum[pOp->type]; i++)
+    {
+        if (   (rplGetSigned(pReader, &arg) != 0)
+            || (arg < INT_MIN) || (arg > INT_MAX))
+        {
+            return(-1);
+        }
+        pOp->arg[i] = arg;
+    }
+
+    pOp->hash = 0;
+    if (   (pOp->type == eRplOpEnd)
+        && (rplGetVarint(pReader, &pOp->hash) != 0))
+    {
+        return(-1);
+    }
+
+    return(1);
+}
+
+/** Writes a replay to a file
+ *  \return 0 if ok, -1 on error */
+int rplSave(const tRplReplay *pReplay, const char *filename)
+{
+    FILE *file = fopen(filename, "wb");
+    int ok;
+
+    if (file == NULL)
+    {
+        return(-1);
+    }
+
+    ok = (fwrite(pReplay->data, 1, pReplay->len, file) == pReplay->len);
+    ok &= (fclose(file) == 0);
+
+    return(ok ? 0 : -1);
+}
+
+/** Reads a replay from a file (the replay initialised or loaded before)
+ *  \return 0 if ok, -1 on error */
+int rplLoad(tRplReplay *pReplay, const char *filename)
+{
+    FILE *file = fopen(filename, "rb");
+    unsigned char buffer[4096];
+    size_t num, i;
+
+    if (file == NULL)
+    {
+        return(-1);
+    }
+
+    pReplay->len = 0;
+
+    while ((num = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+        for (i = 0; i < num; i++)
+        {
+            rplPutByte(pReplay, buffer[i]);
+        }
+    }
+
+    pReplay->ended = 1;
+
+    return((fclose(file) == 0) ? 0 : -1);
+}
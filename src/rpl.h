@@ -0,0 +1,108 @@
+/**
+ * \file  rpl.h
+ * \brief Header for the compact binary replays of games.
+ */
+
+#ifndef _RPL_H_
+#define _RPL_H_
+
+/*------------------------------------------------------------------------------
+   INCLUDES
+------------------------------------------------------------------------------*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*------------------------------------------------------------------------------
+   MACROS
+------------------------------------------------------------------------------*/
+
+/** Maximal number of the level axices of a replayed game */
+#define RPLMAXDIM 8
+
+/** Maximal number of the arguments of an input */
+#define RPLMAXARGS 3
+
+/** Maximal number of the levels of a replayed game */
+#define RPLMAXLENGTH 4096
+
+/** Maximal number of the cells of a level of a replayed game */
+#define RPLMAXLEVELCELLS (1L << 24)
+
+/** Maximal number of the cells of the space of a replayed game */
+#define RPLMAXCELLS (1L << 28)
+
+/*------------------------------------------------------------------------------
+   TYPES
+------------------------------------------------------------------------------*/
+
+/** Kinds of the records of a replay */
+typedef enum
+{
+    eRplOpEnd = 0,  /**< end of the game, with the hash of its final state */
+    eRplOpTurn,     /**< turn: axis 1, axis 2, sign */
+    eRplOpMove,     /**< move: axis, direction */
+    eRplOpLower,    /**< lowering the solid by one level */
+    eRplOpDrop,     /**< dropping the solid */
+    eRplOpFlags,    /**< change of the game flags (see eng.h) */
+    eRplOpNum
+} tRplOpType;
+
+/** A record of a replay: an input of the game at a time */
+typedef struct
+{
+    long       time;            /**< time of the input [msec], read as the
+                                     time since the start of the game */
+    tRplOpType type;            /**< kind of the record */
+    int        arg[RPLMAXARGS]; /**< arguments of the input */
+    uint64_t   hash;            /**< state hash (end record only) */
+} tRplOp;
+
+/** Parameters of a replayed game */
+typedef struct
+{
+    int      dim;               /**< dimension of the game space */
+    uint64_t seed;              /**< seed of the random generator */
+    int      diff;              /**< difficulty level */
+    int      length;            /**< number of levels */
+    int      size[RPLMAXDIM];   /**< level sizes */
+} tRplHeader;
+
+/** A replay: the header and the records encoded into a byte stream;
+ *  the times as varint deltas, the arguments as zigzag varints */
+typedef struct
+{
+    unsigned char *data;        /**< encoded replay */
+    size_t         len;         /**< bytes used */
+    size_t         cap;         /**< bytes allocated */
+    long           time;        /**< time of the last record written */
+    int            flags;       /**< game flags last written, -1 if none */
+    int            ended;       /**< flag of the end record written */
+} tRplReplay;
+
+/** Position of the reading of a replay */
+typedef struct
+{
+    const tRplReplay *pReplay;  /**< replay read */
+    size_t            pos;      /**< position of the next record */
+    long              time;     /**< time of the last record read */
+} tRplReader;
+
+/*------------------------------------------------------------------------------
+   DECLARATIONS
+------------------------------------------------------------------------------*/
+
+extern void rplInit(tRplReplay *pReplay);
+extern void rplFree(tRplReplay *pReplay);
+extern void rplBegin(tRplReplay *pReplay, const tRplHeader *pHeader,
+                     long time);
+extern void rplPut(tRplReplay *pReplay, const tRplOp *pOp);
+
+extern int rplOpen(tRplReader *pReader, tRplHeader *pHeader,
+                   const tRplReplay *pReplay);
+extern int rplRead(tRplReader *pReader, tRplOp *pOp);
+
+extern int rplSave(const tRplReplay *pReplay, const char *filename);
+extern int rplLoad(tRplReplay *pReplay, const char *filename);
+
+#endif /* _RPL_H_ */
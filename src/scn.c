@@ -9,6 +9,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 
 #include "m.h"
@@ -28,6 +29,14 @@
    MACROS
 ------------------------------------------------------------------------------*/
 
+/** number of the level colors, repeated on higher levels */
+#define SCNLEVELCOLORS 20
+
+/** index of the cell (x, y, z) of a level in the game space */
+#define SCNCELL(pSpace, x, y, z) \
+    ((x) * (pSpace)->stride[0] + (y) * (pSpace)->stride[1] + \
+     (z) * (pSpace)->stride[2])
+
 /*------------------------------------------------------------------------------
    TYPES
 ------------------------------------------------------------------------------*/
@@ -42,12 +51,29 @@ static float scn4DWireColor[4] = {0.8, 0.8, 0.9, 1.00};
 /** Color of the 4D grid. */
 static float scn4DGridColor[4] = {0.8, 0.8, 0.9, 0.35};
 
+/** Time of showing the fall of a dropped solid [msec] */
+static const int scnDropTime = 100;
+/** Time of showing a turn of the solid [msec] */
+static const int scnTurnTime = 75;
+/** Time of showing a move or a lowering of the solid [msec] */
+static const int scnMoveTime = 45;
+
 /*------------------------------------------------------------------------------
    GLOBAL VARIABLES
 ------------------------------------------------------------------------------*/
 
 /** array of the colors of game space levels. */
-static float scnLevelColors[SPACELENGTH][4];
+static float scnLevelColors[SCNLEVELCOLORS][4];
+
+/** mask indicates which cells of the levels are hidden by upper blocks,
+    by their index in the level, grown with the space */
+static int *scnMask = NULL;
+/** number of cells in the mask */
+static int scnMaskSize = 0;
+
+/** time of the frame drawn on the engine clock, between the steps of
+    the engine [msec] */
+static long scnFrameTime = 0;
 
 tM3dVector scnCamera = {{0.0, 0.0, 6.0}};
 
@@ -58,18 +84,32 @@ tM3dVector scnCamera = {{0.0, 0.0, 6.0}};
 static void scnDrawBG(void);
 static void scnWriteScore(int score);
 static void scnInitLevelColors(void);
-static void scnDrawRotAxis(int axle, tEngGame *pEngGame);
+static void scnDrawRotAxis(tEngGame *pEngGame, tScnSet *pScnSet);
 static void scnVisibleSides(int n, int (*visibleSides)[eM4dDimNum][2],
-                            tEngBlocks *pEngBlock);
+                            const tEngBlocks *pEngBlock);
 static void scnDrawGamespace(tEngGame *pEngGame,
                              tScnSet *pScnSet,
-                             int mask[SPACESIZE][SPACESIZE][SPACESIZE]);
-static void scnDrawBottomLevel(int mask[SPACESIZE][SPACESIZE][SPACESIZE],
+                             int *mask);
+static void scnDrawBottomLevel(int *mask,
                                int wire,
                                tEngGame *pEngGame);
+static void scnDrawBlocks(const tEngBlocks *pBlocks,
+                          tM4dVector objPos,
+                          tM4dMatrix objAxices,
+                          tEngGame *pEngGame,
+                          tScnSet *pScnSet,
+                          int wire);
+static const tEngBlocks *scnObjectPose(tM4dVector *pPos,
+                                      tM4dMatrix *pAxices,
+                                      tEngGame *pEngGame,
+                                      tScnSet *pScnSet);
 static void scnDrawObject(tEngGame *pEngGame,
                           tScnSet *pScnSet,
                           int wire);
+static void scnDrawDrop(tEngGame *pEngGame,
+                        tScnSet *pScnSet,
+                        int wire);
+static int scnDropShown(tEngGame *pEngGame, tScnSet *pScnSet);
 static tM4dVector scnPosToCoord(int x, int y, int z, int w,
                                 tEngGame *pEngGame);
 static tM4dVector scnCenter(tEngGame *pEngGame);
@@ -82,9 +122,9 @@ static void scnDrawGrid(int enableGridDraw, tEngGame *pEngGame);
 /** Returns with the coordinates of the center of the gamespace */
 static tM4dVector scnCenter(tEngGame *pEngGame)
 {
-    tM4dVector center = m4dVector(pEngGame->size[0]/2.0,
-                                  pEngGame->size[1]/2.0,
-                                  pEngGame->size[2]/2.0,
+    tM4dVector center = m4dVector(pEngGame->space.size[0]/2.0,
+                                  pEngGame->space.size[1]/2.0,
+                                  pEngGame->space.size[2]/2.0,
                                   0.0);
     return(center);
 }
@@ -137,10 +177,22 @@ int scnGetEnableGridDraw(tScnSet *pScnSet)
     return(pScnSet->enableGridDraw);
 }
 
+/** Set function for animation enable flag */
+void scnSetEnableAnimation(int enable, tScnSet *pScnSet)
+{
+    pScnSet->enableAnimation = enable;
+}
+
+/** Get function for animation enable flag */
+int scnGetEnableAnimation(tScnSet *pScnSet)
+{
+    return(pScnSet->enableAnimation);
+}
+
 /** Returns with the default set of scene parameters */
 tScnSet scnGetDefaultSet(void)
 {
-    tScnSet def = { 1, 0, 0, 0, eScnViewMono };
+    tScnSet def = { 1, 0, 0, 0, eScnViewMono, 1 };
 
     return(def);
 }
@@ -163,7 +215,7 @@ static void scnInitLevelColors(void)
     int i, j;
 
     /*  For each level of the game space, */
-    for (i = 0; i < SPACELENGTH; i++)
+    for (i = 0; i < SCNLEVELCOLORS; i++)
     {
         /*  for each color component */
         for (j = 0; j < 3; j++)
@@ -202,19 +254,31 @@ static void scnDrawBG(void)
 }
 
 /** draws the rotation axis selected */
-static void scnDrawRotAxis(int axle, tEngGame *pEngGame)
+static void scnDrawRotAxis(tEngGame *pEngGame, tScnSet *pScnSet)
 {
     int i;
+    int axle = pScnSet->axle;
     const double planeSize = 3.5;
 
     float color0[4] = {1.0, 1.0, 1.0, 0.8};
     float color1[4] = {1.0, 1.0, 1.0, 0.0};
 
+    tM4dVector objPos;
+    tM4dMatrix objAxices;
+
+    /*  with the actual solid, not shown during a fall */
+    if (scnDropShown(pEngGame, pScnSet))
+    {
+        return;
+    }
+
+    scnObjectPose(&objPos, &objAxices, pEngGame, pScnSet);
+
     if ((axle <= 2) && (axle >= 0))
     {
         for (i = -1; i <= 1; i += 2)
         {
-            tM4dVector point0 = pEngGame->object.pos;
+            tM4dVector point0 = objPos;
             tM4dVector point1 = m4dUnitVector(axle);
             point1 = m4dMultiplySV(i * planeSize, point1);
 
@@ -222,7 +286,7 @@ static void scnDrawRotAxis(int axle, tEngGame *pEngGame)
             point1 = m4dAddVectors(point0, point1);
 
             point0.c[eM4dAxisW] =
-                point1.c[eM4dAxisW] = pEngGame->object.pos.c[eM4dAxisW];
+                point1.c[eM4dAxisW] = objPos.c[eM4dAxisW];
 
             g4dDrawLine(point0, point1, color0, color1, 2.5);
         }
@@ -279,7 +343,7 @@ void scnInit(void)
  * n - index of the block in object
  * visibleSides - return array */
 static void scnVisibleSides(int n, int (*visibleSides)[eM4dDimNum][2],
-                            tEngBlocks *pEngBlock)
+                            const tEngBlocks *pEngBlock)
 {
     int i;
 
@@ -320,34 +384,46 @@ static void scnVisibleSides(int n, int (*visibleSides)[eM4dDimNum][2],
 /**  Draw the gamespace. */
 static void scnDrawGamespace(tEngGame *pEngGame,
                              tScnSet *pScnSet,
-                             int mask[SPACESIZE][SPACESIZE][SPACESIZE])
+                             int *mask)
 {
     int l, x, y, z;        /*  loop counter; */
+    int cell[ENGDIM];
+
+    /*  the space before the landing while the fall of a solid is shown,
+        the solid is drawn falling into it */
+    const tEngSpace *pSpace = scnDropShown(pEngGame, pScnSet)
+                              ? &pEngGame->drop.space
+                              : &pEngGame->space;
 
     /*  For each level from top */
-    for (l = pEngGame->spaceLength - 1; l >= 0; l--)
+    for (l = pEngGame->space.length - 1; l >= 0; l--)
     {
         /*  For each cell of the level */
-        for (x = 0; x < pEngGame->size[0]; x++)
-            for (y = 0; y < pEngGame->size[1]; y++)
-                for (z = 0; z < pEngGame->size[2]; z++)
+        for (x = 0; x < pEngGame->space.size[0]; x++)
+            for (y = 0; y < pEngGame->space.size[1]; y++)
+                for (z = 0; z < pEngGame->space.size[2]; z++)
                 {
                     /*  space which has no cube above (so it is visible) */
                     /*  gets rid of Z-fighting */
-                    if (   (mask[x][y][z] == 0)
+                    if (   (mask[SCNCELL(&pEngGame->space, x, y, z)] == 0)
                             || (g4dGetViewType() == eG4d2PointProjection) )
                     {
+                        cell[eM4dAxisX] = x;
+                        cell[eM4dAxisY] = y;
+                        cell[eM4dAxisZ] = z;
+                        cell[eM4dAxisW] = l;
+
                         /*  if the cell is not empty then */
-                        if (engGetSpaceCell(l, x, y, z, pEngGame))
+                        if (engGetCell(cell, pSpace))
                         {
                             /*  draw the cube. */
                             g4dDraw4DCube(scnPosToCoord(x, y, z, l, pEngGame),
                                           m4dUnitMatrix(),
-                                          scnLevelColors[l],
+                                          scnLevelColors[l % SCNLEVELCOLORS],
                                           pScnSet->enableHypercubeDraw ? 4 : 3,
                                           eG4dWireTube, 1, NULL);
 
-                            mask[x][y][z] = 1;
+                            mask[SCNCELL(&pEngGame->space, x, y, z)] = 1;
                         }
                     }
                 }
@@ -359,7 +435,7 @@ static void scnDrawGrid(int enableGridDraw, tEngGame *pEngGame)
 {
     int l;        /*  loop counter; */
 
-    for (l = pEngGame->spaceLength - 1; l >= 0; l--)
+    for (l = pEngGame->space.length - 1; l >= 0; l--)
     {
         if (enableGridDraw)
         {
@@ -373,19 +449,19 @@ static void scnDrawGrid(int enableGridDraw, tEngGame *pEngGame)
 }
 
 /** Draw the bottom level. */
-static void scnDrawBottomLevel(int mask[SPACESIZE][SPACESIZE][SPACESIZE],
+static void scnDrawBottomLevel(int *mask,
                                int wire,
                                tEngGame *pEngGame)
 {
     int x, y, z;        /*  loop counter; */
 
     /*  For each cell of the level do: */
-    for (x = 0; x < pEngGame->size[0]; x++)
-        for (y = 0; y < pEngGame->size[1]; y++)
-            for (z = 0; z < pEngGame->size[2]; z++)
+    for (x = 0; x < pEngGame->space.size[0]; x++)
+        for (y = 0; y < pEngGame->space.size[1]; y++)
+            for (z = 0; z < pEngGame->space.size[2]; z++)
             {
                 /*  space which has no cube above (so it is visible) */
-                if (mask[x][y][z] == 0)
+                if (mask[SCNCELL(&pEngGame->space, x, y, z)] == 0)
                 {
                     g4dDraw4DCube(scnPosToCoord(x, y, z, 0, pEngGame),
                                   m4dUnitMatrix(),
@@ -397,28 +473,32 @@ static void scnDrawBottomLevel(int mask[SPACESIZE][SPACESIZE][SPACESIZE],
 }
 
 
-/** Draw the actual solid. */
-static void scnDrawObject(tEngGame *pEngGame,
+/** Draw the blocks of a solid at a pose. */
+static void scnDrawBlocks(const tEngBlocks *pBlocks,
+                          tM4dVector objPos,
+                          tM4dMatrix objAxices,
+                          tEngGame *pEngGame,
                           tScnSet *pScnSet,
                           int wire)
 {
     int n;        /*  loop counter; */
+
     /*  For each cell */
-    for (n = 0; n < pEngGame->object.block.num; n++)
+    for (n = 0; n < pBlocks->num; n++)
     {
         tM4dVector pos;
         int visibleSides[eM4dDimNum][2];
 
-        scnVisibleSides(n, &visibleSides, &pEngGame->object.block);
+        scnVisibleSides(n, &visibleSides, pBlocks);
 
-        pos = m4dAddVectors(m4dSubVectors(pEngGame->object.pos,
+        pos = m4dAddVectors(m4dSubVectors(objPos,
                                           scnCenter(pEngGame)),
-                            m4dMultiplyMV(pEngGame->object.axices,
-                                          pEngGame->object.block.c[n]));
+                            m4dMultiplyMV(objAxices,
+                                          pBlocks->c[n]));
 
         /*  draw the hypercube. */
         g4dDraw4DCube(pos,
-                      pEngGame->object.axices,
+                      objAxices,
                       wire ? scn4DWireColor : scn4DCubeColor,
                       pScnSet->enableHypercubeDraw ? 4 : 3,
                       wire ? eG4dWireTube : eG4dWireNone,
@@ -427,29 +507,139 @@ static void scnDrawObject(tEngGame *pEngGame,
     }
 }
 
-/** Main drawing function. */
-void scnDisplay(tEngGame *pEngGame, tScnSet *pScnSet)
+/** Pose of the actual solid as displayed: moving from its previous pose
+ *  for a while after it changed, its position interpolated linearly,
+ *  its axices turned in the plane of the turn.
+ *  \return the blocks of the solid */
+static const tEngBlocks *scnObjectPose(tM4dVector *pPos,
+                                      tM4dMatrix *pAxices,
+                                      tEngGame *pEngGame,
+                                      tScnSet *pScnSet)
 {
-    /*  Local variables: */
-    int n, x, y, z;        /*  loop counter; */
+    const tEngBlocks *pBlocks;
+    tM4dVector fromPos;
+    tM4dMatrix fromAxices;
+    long elapsed = scnFrameTime - pEngGame->motion.time;
+    int turn = (pEngGame->motion.axis1 >= 0);
+    double t;
+
+    pBlocks = engGetSolidPose(pPos, pAxices, &pEngGame->object);
+
+    if (   (pEngGame->motion.time != ENGNOTIME)
+        && (elapsed < (turn ? scnTurnTime : scnMoveTime))
+        && pScnSet->enableAnimation)
+    {
+        engGetSolidPose(&fromPos, &fromAxices, &pEngGame->motion.from);
+
+        if (turn)
+        {
+            t = (double)elapsed / scnTurnTime;
+
+            *pAxices = m4dMultiplyMM(m4dRotMatrix(pEngGame->motion.axis1,
+                                                  pEngGame->motion.axis2,
+                                                  pEngGame->motion.sign
+                                                  * t * M_PI / 2.0),
+                                     fromAxices);
+        }
+        else
+        {
+            t = (double)elapsed / scnMoveTime;
 
-    /*  mask indicates which block space */
-    /*  hidden by upper blocks */
-    int mask[SPACESIZE][SPACESIZE][SPACESIZE];
+            *pPos = m4dAddVectors(fromPos,
+                                  m4dMultiplySV(t, m4dSubVectors(*pPos,
+                                                                 fromPos)));
+        }
+    }
+
+    return(pBlocks);
+}
+
+/** Draw the actual solid, after the fall of the one dropped. */
+static void scnDrawObject(tEngGame *pEngGame,
+                          tScnSet *pScnSet,
+                          int wire)
+{
+    const tEngBlocks *pBlocks;
+    tM4dVector objPos;
+    tM4dMatrix objAxices;
+
+    if (scnDropShown(pEngGame, pScnSet))
+    {
+        return;
+    }
+
+    pBlocks = scnObjectPose(&objPos, &objAxices, pEngGame, pScnSet);
+
+    scnDrawBlocks(pBlocks, objPos, objAxices, pEngGame, pScnSet, wire);
+}
+
+/** Flag of showing the fall of the solid dropped last: for a while
+ *  after the drop, in the space before it landed
+ *  \return 1 if shown */
+static int scnDropShown(tEngGame *pEngGame, tScnSet *pScnSet)
+{
+    return(   (pEngGame->drop.time != ENGNOTIME)
+           && (scnFrameTime - pEngGame->drop.time < scnDropTime)
+           && pScnSet->enableAnimation);
+}
+
+/** Draw the solid dropped last falling to where it landed,
+ *  for a while after the drop. */
+static void scnDrawDrop(tEngGame *pEngGame,
+                        tScnSet *pScnSet,
+                        int wire)
+{
+    const tEngBlocks *pBlocks;
+    tM4dVector objPos;
+    tM4dMatrix objAxices;
+    long elapsed = scnFrameTime - pEngGame->drop.time;
+    double fall;
+
+    if (!scnDropShown(pEngGame, pScnSet))
+    {
+        return;
+    }
+
+    pBlocks = engGetSolidPose(&objPos, &objAxices, &pEngGame->drop.object);
+
+    /*  accelerating fall */
+    fall = (double)elapsed / scnDropTime;
+    objPos.c[eM4dAxisW] -= pEngGame->drop.distance * fall * fall;
+
+    scnDrawBlocks(pBlocks, objPos, objAxices, pEngGame, pScnSet, wire);
+}
+
+/** Main drawing function, the motions of the solids shown as at the
+ *  given time of the frame on the engine clock [msec]. */
+void scnDisplay(long frameTime, tEngGame *pEngGame, tScnSet *pScnSet)
+{
+    /*  Local variables: */
+    int n;                 /*  loop counter; */
 
     double camx, camy, camz;
     int pic, maxpic;
 
+    scnFrameTime = frameTime;
+
     maxpic = (pScnSet->viewMode > eScnViewMono) ? 2 : 1;
 
+    /*  grow the mask to the level of the space */
+    if (scnMaskSize < pEngGame->space.levelCells)
+    {
+        free(scnMask);
+        scnMaskSize = pEngGame->space.levelCells;
+        scnMask     = malloc(scnMaskSize * sizeof(int));
+
+        if (scnMask == NULL)
+        {
+            fprintf(stderr, "Out of memory for the scene\n");
+            exit(1);
+        }
+    }
+
     for (pic = 0; pic < maxpic; pic++)
     {
-        for (x = 0; x < pEngGame->size[0]; x++)
-            for (y = 0; y < pEngGame->size[1]; y++)
-                for (z = 0; z < pEngGame->size[2]; z++)
-                {
-                    mask[x][y][z] = 0;
-                }
+        memset(scnMask, 0, pEngGame->space.levelCells * sizeof(int));
 
         if (pScnSet->viewMode == eScnViewStereogram)
         {
@@ -472,23 +662,27 @@ void scnDisplay(tEngGame *pEngGame, tScnSet *pScnSet)
             scnDrawBG();
         }
 
-        scnDrawGamespace(pEngGame, pScnSet, mask);
+        scnDrawGamespace(pEngGame, pScnSet, scnMask);
 
-        scnDrawBottomLevel(mask, 1, pEngGame);
+        scnDrawBottomLevel(scnMask, 1, pEngGame);
 
         scnDrawObject(pEngGame, pScnSet, 1);
 
+        scnDrawDrop(pEngGame, pScnSet, 1);
+
         g3dSetTransparentMode(1);
 
         scnDrawGrid(pScnSet->enableGridDraw, pEngGame);
 
-        scnDrawBottomLevel(mask, 0, pEngGame);
+        scnDrawBottomLevel(scnMask, 0, pEngGame);
 
         scnDrawObject(pEngGame, pScnSet, 0);
 
+        scnDrawDrop(pEngGame, pScnSet, 0);
+
         scnDrawCompass(pEngGame);
 
-        scnDrawRotAxis(pScnSet->axle, pEngGame);
+        scnDrawRotAxis(pEngGame, pScnSet);
 
         g3dSetTransparentMode(0);
 
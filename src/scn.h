@@ -35,6 +35,8 @@ typedef struct
     int axle;
     /** switch for stereo view modes */
     tScnViewMode viewMode;
+    /** Flag indicates if the motion of the solid has to be animated */
+    int enableAnimation;
 }
 tScnSet;
 
@@ -44,7 +46,7 @@ tScnSet;
 
 extern void scnInit(void);
 extern tScnSet scnGetDefaultSet(void);
-extern void scnDisplay(tEngGame *pEngGame, tScnSet *pScnSet);
+extern void scnDisplay(long frameTime, tEngGame *pEngGame, tScnSet *pScnSet);
 
 extern void scnSetViewMode(tScnViewMode mode, tScnSet *pScnSet);
 extern tScnViewMode scnGetViewMode(tScnSet *pScnSet);
@@ -58,4 +60,7 @@ extern int  scnGetEnableSeparateBlockDraw(tScnSet *pScnSet);
 extern void scnSetEnableGridDraw(int enable, tScnSet *pScnSet);
 extern int  scnGetEnableGridDraw(tScnSet *pScnSet);
 
+extern void scnSetEnableAnimation(int enable, tScnSet *pScnSet);
+extern int  scnGetEnableAnimation(tScnSet *pScnSet);
+
 #endif /* _SCN_H_ */